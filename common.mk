@@ -9,6 +9,9 @@ SRC +=	$(COMMON_DIR)/host.c \
 	$(COMMON_DIR)/print.c \
 	$(COMMON_DIR)/debug.c \
 	$(COMMON_DIR)/bootloader.c \
+	$(COMMON_DIR)/debounce.c \
+	$(COMMON_DIR)/matrix_pipeline.c \
+	$(COMMON_DIR)/boot.c \
 	$(COMMON_DIR)/util.c
 
 
@@ -36,6 +39,21 @@ ifdef PS2_MOUSE_ENABLE
     OPT_DEFS += -DPS2_MOUSE_ENABLE
 endif
 
+ifdef PERF_ENABLE
+    SRC += $(COMMON_DIR)/perf.c
+    OPT_DEFS += -DPERF_ENABLE
+endif
+
+ifdef PROF_ENABLE
+    SRC += $(COMMON_DIR)/prof.c
+    OPT_DEFS += -DPROF_ENABLE
+endif
+
+ifdef SLEEP_ENABLE
+    SRC += $(COMMON_DIR)/sleep.c
+    OPT_DEFS += -DSLEEP_ENABLE
+endif
+
 ifdef $(or MOUSEKEY_ENABLE, PS2_MOUSE_ENABLE)
     OPT_DEFS += -DMOUSE_ENABLE
 endif
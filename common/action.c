@@ -14,27 +14,36 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stddef.h>
 #include "host.h"
 #include "timer.h"
 #include "keymap.h"
 #include "keycode.h"
 #include "keyboard.h"
+#include "matrix.h"
 #include "mousekey.h"
 #include "command.h"
 #include "util.h"
 #include "debug.h"
+#include "perf.h"
+#include "prof.h"
 #include "action.h"
 
 
 /* default layer indicates base layer */
 uint8_t default_layer = 0;
-/* current layer indicates active layer at this time */
-uint8_t current_layer = 0;
+/* layers active on top of default layer, bit n is layer n */
+uint16_t layer_state = 0;
 
 
 static void process_action(keyrecord_t *record);
 static bool process_tapping(keyrecord_t *record);
+static uint8_t layer_top(void);
+static uint16_t layer_xor(action_t action);
+static void default_layer_set(uint8_t layer);
 static void waiting_buffer_scan_tap(void);
+static void waiting_buffer_process(void);
+static void waiting_buffer_overflow(keyrecord_t *record);
 
 static void debug_event(keyevent_t event);
 static void debug_record(keyrecord_t record);
@@ -56,6 +65,33 @@ static void debug_waiting_buffer(void);
 #define TAPPING_TOGGLE  5
 #endif
 
+/*
+ * Early hold: tap key pressed and undecided is settled as hold before
+ * TAPPING_TERM passes when
+ *   PERMISSIVE_HOLD:           other key is pressed and released during its hold
+ *   HOLD_ON_OTHER_KEY_PRESS:   other key is pressed during its hold
+ * so that keys typed with tap key as modifier or layer don't wait for the term.
+ * HOLD_ON_OTHER_KEY_PRESS takes quick rolls from tap key to next key as hold.
+ */
+#if TAPPING_TERM >= 500 && !defined(PERMISSIVE_HOLD)
+#define PERMISSIVE_HOLD
+#endif
+
+/*
+ * Per-key tapping term: keymap_tapping_term() gives term of tap key when it
+ * starts tapping, so that check on each event and TICK is still one compare.
+ * 0 from it means TAPPING_TERM.
+ */
+#ifdef TAPPING_TERM_PER_KEY
+static uint16_t tapping_term = TAPPING_TERM;
+static void tapping_term_resolve(void);
+#define TAPPING_TERM_KEY        tapping_term
+#define TAPPING_TERM_RESOLVE()  tapping_term_resolve()
+#else
+#define TAPPING_TERM_KEY        TAPPING_TERM
+#define TAPPING_TERM_RESOLVE()  ((void)0)
+#endif
+
 /* stores a key event of current tap. */
 static keyrecord_t tapping_key = {};
 
@@ -63,15 +99,32 @@ static keyrecord_t tapping_key = {};
 #define IS_TAPPING_PRESSED()    (IS_TAPPING() && tapping_key.event.pressed)
 #define IS_TAPPING_RELEASED()   (IS_TAPPING() && !tapping_key.event.pressed)
 #define IS_TAPPING_KEY(k)       (IS_TAPPING() && KEYEQ(tapping_key.event.key, (k)))
-#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM)
+#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM_KEY)
 
 
 /*
  * Waiting buffer
  *
  * stores key events waiting for settling current tap.
+ * It holds WAITING_BUFFER_SIZE-1 events at most.
  */
-#define WAITING_BUFFER_SIZE 8
+#ifndef WAITING_BUFFER_SIZE
+#define WAITING_BUFFER_SIZE 16
+#endif
+#if WAITING_BUFFER_SIZE > 255
+#   error "WAITING_BUFFER_SIZE should be 255 or less"
+#endif
+
+/* what to do when an event doesn't fit in waiting buffer */
+/* settle current tap as hold, process buffered events and keep going */
+#define WAITING_BUFFER_OVERFLOW_HOLD    0
+/* clear keyboard, waiting buffer and tapping state */
+#define WAITING_BUFFER_OVERFLOW_CLEAR   1
+
+#ifndef WAITING_BUFFER_OVERFLOW
+#define WAITING_BUFFER_OVERFLOW WAITING_BUFFER_OVERFLOW_HOLD
+#endif
+
 static keyrecord_t waiting_buffer[WAITING_BUFFER_SIZE] = {};
 
 /* point to empty cell to enq */
@@ -93,6 +146,7 @@ static bool waiting_buffer_enq(keyrecord_t record)
 
     waiting_buffer[waiting_buffer_head] = record;
     waiting_buffer_head = (waiting_buffer_head + 1) % WAITING_BUFFER_SIZE;
+    PERF_MAX(PERF_MAX_WAITING, waiting_buffer_count());
 
     debug("waiting_buffer_enq: "); debug_waiting_buffer();
     return true;
@@ -104,7 +158,7 @@ static void waiting_buffer_clear(void)
     waiting_buffer_tail = 0;
 }
 
-#if TAPPING_TERM >= 500
+#ifdef PERMISSIVE_HOLD
 static bool waiting_buffer_typed(keyevent_t event)
 {
     for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
@@ -116,6 +170,11 @@ static bool waiting_buffer_typed(keyevent_t event)
 }
 #endif
 
+uint8_t waiting_buffer_count(void)
+{
+    return (waiting_buffer_head - waiting_buffer_tail + WAITING_BUFFER_SIZE) % WAITING_BUFFER_SIZE;
+}
+
 bool waiting_buffer_has_anykey_pressed(void)
 {
     for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
@@ -166,7 +225,10 @@ static void oneshot_toggle(void)
 
 void action_exec(keyevent_t event)
 {
-    if (!IS_NOEVENT(event)) {
+    if (IS_NOEVENT(event)) {
+        PERF_COUNT(PERF_TICK);
+    } else {
+        PERF_COUNT(PERF_EVENT);
         debug("\n---- action_exec: start -----\n");
         debug("EVENT: "); debug_event(event); debug("\n");
     }
@@ -181,11 +243,7 @@ void action_exec(keyevent_t event)
     } else {
         // enqueue
         if (!waiting_buffer_enq(record)) {
-            // clear all in case of overflow.
-            debug("OVERFLOW: CLEAR ALL STATES\n");
-            clear_keyboard();
-            waiting_buffer_clear();
-            tapping_key = (keyrecord_t){};
+            waiting_buffer_overflow(&record);
         }
     }
 
@@ -193,7 +251,16 @@ void action_exec(keyevent_t event)
     if (!IS_NOEVENT(event) && waiting_buffer_head != waiting_buffer_tail) {
         debug("---- action_exec: process waiting_buffer -----\n");
     }
+    waiting_buffer_process();
+
+    if (!IS_NOEVENT(event)) {
+        debug("\n");
+    }
+}
 
+/* process buffered events in order until one has to wait again */
+static void waiting_buffer_process(void)
+{
     for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) % WAITING_BUFFER_SIZE) {
         if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
             debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
@@ -202,23 +269,131 @@ void action_exec(keyevent_t event)
             break;
         }
     }
-    if (!IS_NOEVENT(event)) {
-        debug("\n");
+}
+
+/*
+ * Event doesn't fit in waiting buffer.
+ * Buffer grows only while tapping key is pressed and undecided, so the
+ * key is settled as hold early and buffered events go on to be processed
+ * as if its TAPPING_TERM had passed. State is cleared only when that
+ * can't make room.
+ */
+static void waiting_buffer_overflow(keyrecord_t *record)
+{
+    PERF_COUNT(PERF_WAITING_OVERFLOW);
+#if WAITING_BUFFER_OVERFLOW == WAITING_BUFFER_OVERFLOW_HOLD
+    if (IS_TAPPING_PRESSED() && tapping_key.tap_count == 0) {
+        debug("OVERFLOW: SETTLE TAPPING KEY AS HOLD\n");
+        process_action(&tapping_key);
+        tapping_key = (keyrecord_t){};
+        debug_tapping_key();
+    }
+    // tap is settled now(or was by this record) and buffered events can go
+    waiting_buffer_process();
+    // keep order: record goes after events still buffered
+    if (waiting_buffer_head == waiting_buffer_tail && process_tapping(record)) return;
+    if (waiting_buffer_enq(*record)) return;
+#endif
+    // clear all in case of overflow.
+    debug("OVERFLOW: CLEAR ALL STATES\n");
+    clear_keyboard();
+    waiting_buffer_clear();
+    tapping_key = (keyrecord_t){};
+}
+
+/*
+ * TICK has work only while tapping key waits for its TAPPING_TERM to pass.
+ * TICK time is made odd and can be 1ms ahead of timer, so a deadline here
+ * is 1ms early rather than late.
+ */
+uint16_t action_deadline(void)
+{
+    if (waiting_buffer_head != waiting_buffer_tail && !IS_TAPPING()) return 0;
+    if (!IS_TAPPING()) return TIMER_NO_DEADLINE;
+    if (IS_TAPPING_PRESSED() && tapping_key.tap_count > 0) return TIMER_NO_DEADLINE;
+
+    uint16_t elapsed = timer_elapsed(tapping_key.event.time);
+    return (elapsed + 1 >= TAPPING_TERM_KEY ? 0 : TAPPING_TERM_KEY - 1 - elapsed);
+}
+
+/*
+ * Action cache
+ *
+ * Actions resolved through layer stack are kept in RAM so that events and
+ * tapping decisions don't walk layers and read keymap from PROGMEM every time.
+ * Cache is discarded when layer_state or default_layer differs from ones it
+ * was filled with.
+ */
+#ifdef ACTION_CACHE
+static action_t action_cache[MATRIX_ROWS][MATRIX_COLS];
+static matrix_row_t action_cached[MATRIX_ROWS];
+static uint16_t action_cache_state = 0;
+static uint8_t action_cache_default = 0;
+
+void action_cache_clear(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        action_cached[r] = 0;
+    }
+    action_cache_state = layer_state;
+    action_cache_default = default_layer;
+}
+#endif
+
+/* layer_out receives layer which action comes from unless NULL */
+static action_t resolve_action(key_t key, uint8_t *layer_out)
+{
+    action_t action;
+
+    /* from highest active layer down, transparent falls through to next */
+    uint16_t state = layer_state;
+    while (state) {
+        uint8_t layer = biton16(state);
+        action = action_for_key(layer, key);
+        if (action.code != ACTION_TRANSPARENT) {
+            if (layer_out) *layer_out = layer;
+            return action;
+        }
+        debug("TRNASPARENT: "); debug_dec(layer); debug("\n");
+        state &= ~((uint16_t)1<<layer);
     }
+    if (layer_out) *layer_out = default_layer;
+    return action_for_key(default_layer, key);
 }
 
 static action_t get_action(key_t key)
 {
-    action_t action = action_for_key(current_layer, key);
+#ifdef ACTION_CACHE
+    if (action_cache_state != layer_state || action_cache_default != default_layer) {
+        action_cache_clear();
+    }
 
-    /* Transparently use default layer */
-    if (action.code == ACTION_TRANSPARENT) {
-        // TODO: layer stacking
-        action = action_for_key(default_layer, key);
-        debug("TRNASPARENT: "); debug_hex16(action.code); debug("\n");
+    /* TICK and NOEVENT have no place in cache */
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) {
+        return resolve_action(key, NULL);
     }
-    return action;
+
+    matrix_row_t col_bit = (matrix_row_t)1<<key.col;
+    if (!(action_cached[key.row] & col_bit)) {
+        action_cache[key.row][key.col] = resolve_action(key, NULL);
+        action_cached[key.row] |= col_bit;
+    }
+    return action_cache[key.row][key.col];
+#else
+    return resolve_action(key, NULL);
+#endif
+}
+
+#ifdef TAPPING_TERM_PER_KEY
+static void tapping_term_resolve(void)
+{
+    uint8_t layer;
+    resolve_action(tapping_key.event.key, &layer);
+    tapping_term = keymap_tapping_term(layer, tapping_key.event.key);
+    if (!tapping_term) tapping_term = TAPPING_TERM;
+    debug("TAPPING_TERM: "); debug_dec(tapping_term); debug("\n");
 }
+#endif
 
 static void process_action(keyrecord_t *record)
 {
@@ -227,6 +402,7 @@ static void process_action(keyrecord_t *record)
 
     if (IS_NOEVENT(event)) { return; }
 
+    PROF_BEGIN(PROF_PROCESS_ACTION);
     action_t action = get_action(event.key);
     debug("ACTION: "); debug_action(action); debug("\n");
 
@@ -242,6 +418,10 @@ static void process_action(keyrecord_t *record)
                     if (mods) {
                         host_add_mods(mods);
                         host_send_keyboard_report();
+#ifdef REPORT_MODS_BEFORE_KEY
+                        // some hosts need mods in a report prior to key
+                        host_flush_keyboard_report();
+#endif
                     }
                     register_code(action.key.code);
                     if (mods && action.key.code) {
@@ -421,8 +601,7 @@ static void process_action(keyrecord_t *record)
                     break;
                 case LAYER_CHANGE_DEFAULT:  /* change default layer */
                     if (event.pressed) {
-                        default_layer = action.layer.val;
-                        layer_switch(default_layer);
+                        default_layer_set(action.layer.val);
                     }
                     break;
                 default:    /* switch layer on hold and key on tap*/
@@ -449,45 +628,42 @@ static void process_action(keyrecord_t *record)
             }
             break;
         case ACT_LAYER_BIT:
+        case ACT_LAYER_STACK:
             switch (action.layer.code) {
                 case LAYER_MOMENTARY:  /* momentary */
                     if (event.pressed) {
-                        layer_switch(current_layer ^ action.layer.val);
+                        layer_state_set(layer_xor(action));
                     } else {
-                        layer_switch(current_layer ^ action.layer.val);
+                        layer_state_set(layer_xor(action));
                     }
                     break;
                 case LAYER_ON_PRESS:
                     if (event.pressed) {
-                        layer_switch(current_layer ^ action.layer.val);
+                        layer_state_set(layer_xor(action));
                     }
                     break;
                 case LAYER_ON_RELEASE:
                     if (!event.pressed) {
-                        layer_switch(current_layer ^ action.layer.val);
+                        layer_state_set(layer_xor(action));
                     }
                     break;
                 case LAYER_TAP_TOGGLE:  /* switch on hold and toggle on several taps */
                     if (event.pressed) {
                         if (tap_count < TAPPING_TOGGLE) {
                             debug("LAYER_BIT: tap toggle(press).\n");
-                            layer_switch(current_layer ^ action.layer.val);
+                            layer_state_set(layer_xor(action));
                         }
                     } else {
                         if (tap_count <= TAPPING_TOGGLE) {
                             debug("LAYER_BIT: tap toggle(release).\n");
-                            layer_switch(current_layer ^ action.layer.val);
+                            layer_state_set(layer_xor(action));
                         }
                     }
                     break;
                 case 0xFF:
                     // change default layer
-                    if (event.pressed) {
-                        default_layer = current_layer ^ action.layer.val;
-                        layer_switch(default_layer);
-                    } else {
-                        default_layer = current_layer ^ action.layer.val;
-                        layer_switch(default_layer);
+                    if (action.kind.id == ACT_LAYER_BIT) {
+                        default_layer_set(layer_top() ^ action.layer.val);
                     }
                     break;
                 default:
@@ -498,7 +674,7 @@ static void process_action(keyrecord_t *record)
                             register_code(action.layer.code);
                         } else {
                             debug("LAYER_BIT: No tap: layer_switch(bit on)\n");
-                            layer_switch(current_layer ^ action.layer.val);
+                            layer_state_set(layer_xor(action));
                         }
                     } else {
                         if (IS_TAPPING_KEY(event.key) && tap_count > 0) {
@@ -506,7 +682,7 @@ static void process_action(keyrecord_t *record)
                             unregister_code(action.layer.code);
                         } else {
                             debug("LAYER_BIT: No tap: layer_switch(bit off)\n");
-                            layer_switch(current_layer ^ action.layer.val);
+                            layer_state_set(layer_xor(action));
                         }
                     }
                     break;
@@ -525,6 +701,8 @@ static void process_action(keyrecord_t *record)
         default:
             break;
     }
+    action_processed(record);
+    PROF_END(PROF_PROCESS_ACTION);
 }
 
 /* Tapping
@@ -552,7 +730,19 @@ static bool process_tapping(keyrecord_t *keyp)
                     keyp->tap_count = tapping_key.tap_count;
                     return false;
                 }
-#if TAPPING_TERM >= 500
+#ifdef HOLD_ON_OTHER_KEY_PRESS
+                else if (event.pressed) {
+                    // other key pressed. not tap.
+                    debug("Tapping: End. No tap. Interfered by pressing key\n");
+                    process_action(&tapping_key);
+                    tapping_key = (keyrecord_t){};
+                    debug_tapping_key();
+
+                    // enqueue
+                    return false;
+                }
+#endif
+#ifdef PERMISSIVE_HOLD
                 /* This can prevent from typing some tap keys in a row at a time. */
                 else if (!event.pressed && waiting_buffer_typed(event)) {
                     // other key typed. not tap.
@@ -594,6 +784,7 @@ static bool process_tapping(keyrecord_t *keyp)
                         debug("Tapping: Start while last tap(1).\n");
                     }
                     tapping_key = *keyp;
+                    TAPPING_TERM_RESOLVE();
                     waiting_buffer_scan_tap();
                     debug_tapping_key();
                     return true;
@@ -638,6 +829,7 @@ static bool process_tapping(keyrecord_t *keyp)
                         debug("Tapping: Start while last timeout tap(1).\n");
                     }
                     tapping_key = *keyp;
+                    TAPPING_TERM_RESOLVE();
                     waiting_buffer_scan_tap();
                     debug_tapping_key();
                     return true;
@@ -665,6 +857,7 @@ static bool process_tapping(keyrecord_t *keyp)
                 // Sequential tap can be interfered with other tap key.
                 debug("Tapping: Start with interfering other tap.\n");
                 tapping_key = *keyp;
+                TAPPING_TERM_RESOLVE();
                 waiting_buffer_scan_tap();
                 debug_tapping_key();
                 return true;
@@ -687,6 +880,7 @@ static bool process_tapping(keyrecord_t *keyp)
         if (event.pressed && is_tap_key(event.key)) {
             debug("Tapping: Start(Press tap key).\n");
             tapping_key = *keyp;
+            TAPPING_TERM_RESOLVE();
             waiting_buffer_scan_tap();
             debug_tapping_key();
             return true;
@@ -737,6 +931,10 @@ void register_code(uint8_t code)
         if (oneshot_state.mods && oneshot_state.ready && !oneshot_state.disabled) {
             uint8_t tmp_mods = host_get_mods();
             host_add_mods(oneshot_state.mods);
+#ifdef REPORT_MODS_BEFORE_KEY
+            host_send_keyboard_report();
+            host_flush_keyboard_report();
+#endif
             host_add_key(code);
             host_send_keyboard_report();
 
@@ -813,18 +1011,53 @@ bool sending_anykey(void)
             host_last_sysytem_report() || host_last_consumer_report());
 }
 
-void layer_switch(uint8_t new_layer)
+void layer_state_set(uint16_t state)
 {
-    if (current_layer != new_layer) {
-        debug("Layer Switch: "); debug_hex(current_layer);
-        debug(" -> "); debug_hex(new_layer); debug("\n");
+    if (layer_state != state) {
+        debug("Layer State: "); debug_hex16(layer_state);
+        debug(" -> "); debug_hex16(state); debug("\n");
 
-        current_layer = new_layer;
+        layer_state = state;
         clear_keyboard_but_mods(); // To avoid stuck keys
         // NOTE: update mods with full scan of matrix? if modifier changes between layers
     }
 }
 
+/* make new_layer only active layer on default layer */
+void layer_switch(uint8_t new_layer)
+{
+    layer_state_set(new_layer == default_layer ? 0 : (uint16_t)1<<new_layer);
+}
+
+/* highest active layer */
+static uint8_t layer_top(void)
+{
+    return layer_state ? biton16(layer_state) : default_layer;
+}
+
+/* layer_state after ACT_LAYER_BIT or ACT_LAYER_STACK action
+ * ACT_LAYER_BIT xors its bits with highest active layer and makes result
+ * only active layer as current_layer did, ACT_LAYER_STACK toggles its layer
+ * on layer stack. */
+static uint16_t layer_xor(action_t action)
+{
+    if (action.kind.id == ACT_LAYER_STACK) {
+        return layer_state ^ (uint16_t)1<<action.layer.val;
+    }
+    uint8_t layer = layer_top() ^ action.layer.val;
+    return (layer == default_layer ? 0 : (uint16_t)1<<layer);
+}
+
+static void default_layer_set(uint8_t layer)
+{
+    debug("Default Layer: "); debug_dec(default_layer);
+    debug(" -> "); debug_dec(layer); debug("\n");
+
+    default_layer = layer;
+    layer_state = 0;
+    clear_keyboard_but_mods(); // To avoid stuck keys
+}
+
 bool is_tap_key(key_t key)
 {
     action_t action = get_action(key);
@@ -835,6 +1068,7 @@ bool is_tap_key(key_t key)
             return true;
         case ACT_LAYER:
         case ACT_LAYER_BIT:
+        case ACT_LAYER_STACK:
             switch (action.layer.code) {
                 case LAYER_MOMENTARY:
                 case LAYER_ON_PRESS:
@@ -854,6 +1088,13 @@ bool is_tap_key(key_t key)
 }
 
 
+/* called after action of record is performed. for tracing and profiling. */
+__attribute__ ((weak))
+void action_processed(keyrecord_t *record)
+{
+}
+
+
 /*
  * debug print
  */
@@ -878,6 +1119,7 @@ static void debug_action(action_t action)
         case ACT_MOUSEKEY:          debug("ACT_MOUSEKEY");          break;
         case ACT_LAYER:             debug("ACT_LAYER");     break;
         case ACT_LAYER_BIT:         debug("ACT_LAYER_BIT");         break;
+        case ACT_LAYER_STACK:       debug("ACT_LAYER_STACK");       break;
         case ACT_MACRO:             debug("ACT_MACRO");             break;
         case ACT_COMMAND:           debug("ACT_COMMAND");           break;
         case ACT_FUNCTION:          debug("ACT_FUNCTION");          break;
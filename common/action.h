@@ -76,10 +76,10 @@ typedef union {
 
 
 
-/* layer used currently */
-extern uint8_t current_layer;
-/* layer to return or start with */
+/* layer to return or start with, bottom of layer stack */
 extern uint8_t default_layer;
+/* active layers stacked on default layer(bit n is layer n), higher layer is looked up first */
+extern uint16_t layer_state;
 
 /* Execute action per keyevent */
 void action_exec(keyevent_t event);
@@ -90,6 +90,17 @@ action_t action_for_key(uint8_t layer, key_t key);
 /* user defined special function */
 void action_function(keyrecord_t *record, uint8_t id, uint8_t opt);
 
+/* called after action of record is performed(weak, no-op by default) */
+void action_processed(keyrecord_t *record);
+
+/* wait(ms) till action_exec(TICK) has work to do, TIMER_NO_DEADLINE when idle */
+uint16_t action_deadline(void);
+
+#ifdef ACTION_CACHE
+/* discard cached actions, call this when keymap is changed at runtime */
+void action_cache_clear(void);
+#endif
+
 /*
  * Utilities for actions.
  */
@@ -102,8 +113,10 @@ void clear_keyboard(void);
 void clear_keyboard_but_mods(void);
 bool sending_anykey(void);
 void layer_switch(uint8_t new_layer);
+void layer_state_set(uint16_t state);
 bool is_tap_key(key_t key);
 bool waiting_buffer_has_anykey_pressed(void);
+uint8_t waiting_buffer_count(void);
 
 
 
@@ -164,6 +177,7 @@ bool waiting_buffer_has_anykey_pressed(void);
  * -------------
  * ACT_LAYER(1000):            Set layer
  * ACT_LAYER_BIT(1001):        Bit-op layer
+ * ACT_LAYER_STACK(1010):      Stack layer
  *
  * 1000|LLLL|0000 0000   set L to layer on press and set default on release(momentary)
  * 1000|LLLL|0000 0001   set L to layer on press
@@ -181,6 +195,14 @@ bool waiting_buffer_has_anykey_pressed(void);
  * 1001|BBBB|1111 0000   bit-xor layer with B while hold and toggle on several taps
  * 1001|BBBB|1111 1111   bit-xor default with B and set layer(on press)
  *
+ * 1010|LLLL|0000 0000   toggle L on layer stack on both press and release(momentary)
+ * 1010|LLLL|0000 0001   toggle L on layer stack on press
+ * 1010|LLLL|0000 0010   toggle L on layer stack on release
+ * 1010|LLLL|0000 0011   (not used)
+ * 1010|LLLL| keycode    toggle L on layer stack while hold and send key on tap
+ * 1010|LLLL|1111 0000   toggle L on layer stack while hold and toggle on several taps
+ * 1010|LLLL|1111 1111   (not used)
+ *
  *
  *
  * Extensions(11XX)
@@ -210,6 +232,7 @@ enum action_kind_id {
 
     ACT_LAYER           = 0b1000,
     ACT_LAYER_BIT       = 0b1001,
+    ACT_LAYER_STACK     = 0b1010,
 
     ACT_MACRO           = 0b1100,
     ACT_COMMAND         = 0b1110,
@@ -317,6 +340,23 @@ enum layer_vals_default {
 /* bit-xor default layer and set layer */
 #define ACTION_LAYER_BIT_DEFAULT(bits)          ACTION(ACT_LAYER, (bits)<<8 | LAYER_CHANGE_DEFAULT)
 
+/*
+ * Stack layer
+ */
+/* stack layer on press and remove on release */
+#define ACTION_LAYER_STACK(layer)               ACTION_LAYER_STACK_MOMENTARY(layer)
+#define ACTION_LAYER_STACK_MOMENTARY(layer)     ACTION(ACT_LAYER_STACK, (layer)<<8 | LAYER_MOMENTARY)
+/* stack or remove layer on release */
+#define ACTION_LAYER_STACK_TOGGLE(layer)        ACTION_LAYER_STACK_R(layer)
+/* stack layer while hold and send key on tap */
+#define ACTION_LAYER_STACK_TAP_KEY(layer, key)  ACTION(ACT_LAYER_STACK, (layer)<<8 | (key))
+/* stack or remove layer on press */
+#define ACTION_LAYER_STACK_P(layer)             ACTION(ACT_LAYER_STACK, (layer)<<8 | LAYER_ON_PRESS)
+/* stack or remove layer on release */
+#define ACTION_LAYER_STACK_R(layer)             ACTION(ACT_LAYER_STACK, (layer)<<8 | LAYER_ON_RELEASE)
+/* stack layer while hold and toggle on several taps */
+#define ACTION_LAYER_STACK_TAP_TOGGLE(layer)    ACTION(ACT_LAYER_STACK, (layer)<<8 | LAYER_TAP_TOGGLE)
+
 
 /* HID Usage */
 enum usage_pages {
@@ -14,54 +14,242 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-#include <util/delay.h>
 #include "debug.h"
+#include "timer.h"
+#include "host.h"
+#include "keycode.h"
+#include "report.h"
+#include "mousekey.h"
 #include "action.h"
 #include "action_macro.h"
 
 
+/*
+ * Macro player
+ *
+ * Macros are queued and played a step at a time from keyboard_task() so
+ * that WAIT and INTERVAL don't stop matrix scan and USB task. A step runs
+ * commands till one which changes report or waits, next step is due when
+ * its wait passes and action_macro_deadline() tells keyboard_task that.
+ * As with the blocking player every key, mods and INTERVAL command is
+ * followed by interval and WAIT waits its time plus interval.
+ */
+#ifndef MACRO_QUEUE_SIZE
+#define MACRO_QUEUE_SIZE 4
+#endif
+
+static const prog_macro_t *macro_queue[MACRO_QUEUE_SIZE];
+static uint8_t macro_queue_head = 0;
+static uint8_t macro_queue_tail = 0;
+
+#ifndef MACRO_MODS_STACK_SIZE
+#define MACRO_MODS_STACK_SIZE 4
+#endif
+
+/* program counter of macro playing, 0 when idle */
+static const prog_macro_t *macro_p = 0;
+static uint8_t macro_interval = 0;
+static uint16_t macro_wait_start = 0;
+static uint16_t macro_wait = 0;
+
+/* keys left in type run and whether last one read is down */
+static uint8_t macro_type_left = 0;
+static bool macro_type_down = false;
+
+/* loop body start and times left to play it */
+static const prog_macro_t *macro_loop_p = 0;
+static uint8_t macro_loop_left = 0;
+
+static uint8_t macro_mods_stack[MACRO_MODS_STACK_SIZE];
+static uint8_t macro_mods_sp = 0;
+
+void action_macro_play(const prog_macro_t *macro)
+{
+    if (!macro) return;
+
+    uint8_t next = (macro_queue_head + 1) % MACRO_QUEUE_SIZE;
+    if (next == macro_queue_tail) {
+        debug("MACRO: queue full\n");
+        return;
+    }
+    macro_queue[macro_queue_head] = macro;
+    macro_queue_head = next;
+}
+
+static void macro_wait_set(uint16_t ms)
+{
+    macro_wait_start = timer_read();
+    macro_wait = ms;
+}
+
+/* keycode of any kind: key and mods, system, consumer and mousekey */
+static void macro_ext_key(uint8_t code, bool pressed)
+{
+    if (IS_KEY(code) || IS_MOD(code)) {
+        if (pressed) register_code(code); else unregister_code(code);
+    }
+#ifdef EXTRAKEY_ENABLE
+    else if (IS_SYSTEM(code)) {
+        host_system_send(pressed ? KEYCODE2SYSTEM(code) : 0);
+    }
+    else if (IS_CONSUMER(code)) {
+        host_consumer_send(pressed ? KEYCODE2CONSUMER(code) : 0);
+    }
+#endif
+#ifdef MOUSEKEY_ENABLE
+    else if (IS_MOUSEKEY(code)) {
+        if (pressed) mousekey_on(code); else mousekey_off(code);
+        mousekey_send();
+    }
+#endif
+}
+
+static void macro_type_next(void)
+{
+    macro_t key = pgm_read_byte(macro_p++);
+    debug("DOWN("); debug_hex(key); debug(")\n");
+    register_code(key);
+    macro_type_left--;
+    macro_type_down = true;
+    macro_wait_set(macro_interval);
+}
+
 #define MACRO_READ()  (macro = pgm_read_byte(macro_p++))
-void action_macro_play(const prog_macro_t *macro_p)
+void action_macro_task(void)
 {
     macro_t macro = END;
-    uint8_t interval = 0;
 
-    if (!macro_p) return;
+    if (!macro_p) {
+        if (macro_queue_tail == macro_queue_head) return;
+        macro_p = macro_queue[macro_queue_tail];
+        macro_queue_tail = (macro_queue_tail + 1) % MACRO_QUEUE_SIZE;
+        macro_interval = 0;
+        macro_wait = 0;
+        macro_type_left = 0;
+        macro_type_down = false;
+        macro_loop_left = 0;
+        macro_mods_sp = 0;
+    }
+    if (timer_elapsed(macro_wait_start) < macro_wait) return;
+
+    /* type run: key read last is released, then next key is pressed */
+    if (macro_type_down) {
+        macro = pgm_read_byte(macro_p - 1);
+        debug("UP("); debug_hex(macro); debug(")\n");
+        unregister_code(macro);
+        macro_type_down = false;
+        macro_wait_set(macro_interval);
+        return;
+    }
+    if (macro_type_left) {
+        macro_type_next();
+        return;
+    }
+
     while (true) {
         switch (MACRO_READ()) {
             case INTERVAL:
-                interval = MACRO_READ();
-                debug("INTERVAL("); debug_dec(interval); debug(")\n");
-                break;
+                macro_interval = MACRO_READ();
+                debug("INTERVAL("); debug_dec(macro_interval); debug(")\n");
+                macro_wait_set(macro_interval);
+                return;
             case WAIT:
                 MACRO_READ();
                 debug("WAIT("); debug_dec(macro); debug(")\n");
-                { uint8_t ms = macro; while (ms--) _delay_ms(1); }
-                break;
+                macro_wait_set(macro + macro_interval);
+                return;
             case MODS_DOWN:
                 MACRO_READ();
                 debug("MODS_DOWN("); debug_hex(macro); debug(")\n");
-                debug("MODS_UP("); debug_hex(macro); debug(")\n");
                 add_mods(macro);
-                break;
+                macro_wait_set(macro_interval);
+                return;
             case MODS_UP:
                 MACRO_READ();
                 debug("MODS_UP("); debug_hex(macro); debug(")\n");
                 del_mods(macro);
+                macro_wait_set(macro_interval);
+                return;
+            case MODS_SET:
+                MACRO_READ();
+                debug("MODS_SET("); debug_hex(macro); debug(")\n");
+                set_mods(macro);
+                macro_wait_set(macro_interval);
+                return;
+            case MODS_PUSH:
+                debug("MODS_PUSH\n");
+                if (macro_mods_sp < MACRO_MODS_STACK_SIZE) {
+                    macro_mods_stack[macro_mods_sp++] = host_get_mods();
+                } else {
+                    debug("MACRO: mods stack full\n");
+                }
+                break;
+            case MODS_POP:
+                debug("MODS_POP\n");
+                if (macro_mods_sp) {
+                    set_mods(macro_mods_stack[--macro_mods_sp]);
+                    macro_wait_set(macro_interval);
+                    return;
+                }
+                debug("MACRO: mods stack empty\n");
+                break;
+            case EXT_DOWN:
+                MACRO_READ();
+                debug("EXT_DOWN("); debug_hex(macro); debug(")\n");
+                macro_ext_key(macro, true);
+                macro_wait_set(macro_interval);
+                return;
+            case EXT_UP:
+                MACRO_READ();
+                debug("EXT_UP("); debug_hex(macro); debug(")\n");
+                macro_ext_key(macro, false);
+                macro_wait_set(macro_interval);
+                return;
+            case TYPE_RUN:
+                macro_type_left = MACRO_READ();
+                debug("TYPE_RUN("); debug_dec(macro); debug(")\n");
+                if (macro_type_left) {
+                    macro_type_next();
+                    return;
+                }
+                break;
+            case LOOP:
+                macro_loop_left = MACRO_READ();
+                macro_loop_p = macro_p;
+                debug("LOOP("); debug_dec(macro_loop_left); debug(")\n");
+                break;
+            case LOOP_END:
+                debug("LOOP_END\n");
+                if (macro_loop_left > 1) {
+                    macro_loop_left--;
+                    macro_p = macro_loop_p;
+                } else {
+                    macro_loop_left = 0;
+                }
                 break;
             case 0x04 ... 0x73:
                 debug("DOWN("); debug_hex(macro); debug(")\n");
                 register_code(macro);
-                break;
+                macro_wait_set(macro_interval);
+                return;
             case 0x84 ... 0xF3:
                 debug("UP("); debug_hex(macro); debug(")\n");
                 unregister_code(macro&0x7F);
-                break;
+                macro_wait_set(macro_interval);
+                return;
             case END:
             default:
+                macro_p = 0;
                 return;
         }
-        // interval
-        { uint8_t ms = interval; while (ms--) _delay_ms(1); }
     }
 }
+
+uint16_t action_macro_deadline(void)
+{
+    if (!macro_p) {
+        return (macro_queue_tail == macro_queue_head ? TIMER_NO_DEADLINE : 0);
+    }
+    uint16_t elapsed = timer_elapsed(macro_wait_start);
+    return (elapsed >= macro_wait ? 0 : macro_wait - elapsed);
+}
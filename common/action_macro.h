@@ -24,84 +24,85 @@ typedef uint8_t macro_t;
 typedef macro_t prog_macro_t PROGMEM;
 
 
+/* queue macro, it is played by action_macro_task() in following keyboard_task() */
 void action_macro_play(const prog_macro_t *macro);
-
-
-
-/* TODO: NOT FINISHED 
-normal mode command:
-    key(down):      0x04-7f/73(F24)
-    key(up):        0x84-ff
-command:        0x00-03, 0x80-83(0x74-7f, 0xf4-ff)
-    mods down   0x00
-    mods up     0x01
-    wait        0x02
-    interval    0x03
-    extkey down 0x80
-    extkey up   0x81
-    ext commad  0x82
-    ext mode    0x83
-    end         0xff
-
-extension mode command: NOT IMPLEMENTED
-    key down            0x00
-    key up              0x01
-    key down + wait
-    key up   + wait
-    mods push
-    mods pop
-    wait
-    interval
-    if
-    loop
-    push
-    pop
-    all up
-    end
-*/
+/* play a step of macro when its wait has passed */
+void action_macro_task(void);
+/* wait(ms) till next step of macro, TIMER_NO_DEADLINE when no macro */
+uint16_t action_macro_deadline(void);
+
+
+
+/* Macro bytecode
+ *
+ * key(down):       0x04-0x73(A-F24)
+ * key(up):         0x84-0xF3
+ * command:         0x00-0x03, 0x74-0x7F(0x80-0x83, 0xF4-0xFF are reserved)
+ *   end            0x00
+ *   mods down      0x01 mods
+ *   mods up        0x02 mods
+ *   mods set       0x03 mods
+ *   wait           0x74 ms
+ *   interval       0x75 ms         wait after each key and mods command
+ *   mods push      0x76            save mods on stack(MACRO_MODS_STACK_SIZE)
+ *   mods pop       0x77            restore mods saved last
+ *   extkey down    0x78 keycode    any keycode out of 0x04-0x73
+ *   extkey up      0x79 keycode
+ *   type run       0x7A n key*n    type(down and up) n keys of 0x04-0x73
+ *   loop           0x7B n          play till loop end n times, not nested
+ *   loop end       0x7C
+ *
+ * Key and mods commands, and each down or up of type run, are a step of
+ * player which sends one report. Use tool macro_asm of native build to
+ * assemble text of these macros into compact form and disassemble.
+ */
 enum macro_command_id{
     /* 0x00 - 0x03 */
     END                 = 0x00,
     MODS_DOWN           = 0x01,
     MODS_UP             = 0x02,
-    MODS_SET,
-    MODS_PUSH,
-    MODS_POP,
+    MODS_SET            = 0x03,
 
+    /* 0x74 - 0x7F */
     WAIT                = 0x74,
     INTERVAL,
-    /* 0x74 - 0x7f */
-    /* 0x80 - 0x84 */
-
+    MODS_PUSH,
+    MODS_POP,
     EXT_DOWN,
     EXT_UP,
-    EXT_WAIT,
-    EXT_INTERVAL,
-    COMPRESSION_MODE,
-
-    EXTENSION_MODE      = 0xff,
+    TYPE_RUN,
+    LOOP,
+    LOOP_END,
 };
 
 
-/* normal mode */
+/* commands */
 #define DOWN(key)       (key)
 #define UP(key)         ((key) | 0x80)
 #define TYPE(key)       (key), (key | 0x80)
 #define MODS_DOWN(mods) MODS_DOWN, (mods)
 #define MODS_UP(mods)   MODS_UP, (mods)
+#define MODS_SET(mods)  MODS_SET, (mods)
 #define WAIT(ms)        WAIT, (ms)
 #define INTERVAL(ms)    INTERVAL, (ms)
+#define EXT_DOWN(key)   EXT_DOWN, (key)
+#define EXT_UP(key)     EXT_UP, (key)
+#define EXT_TYPE(key)   EXT_DOWN, (key), EXT_UP, (key)
+#define TYPE_RUN(n)     TYPE_RUN, (n)   /* followed by n keycodes */
+#define LOOP(n)         LOOP, (n)
 
 #define D(key)          DOWN(KC_##key)
 #define U(key)          UP(KC_##key)
 #define T(key)          TYPE(KC_##key)
 #define MD(key)         MODS_DOWN(MOD_BIT(KC_##key))
 #define MU(key)         MODS_UP(MOD_BIT(KC_##key))
+#define MS(key)         MODS_SET(MOD_BIT(KC_##key))
 #define W(ms)           WAIT(ms)
 #define I(ms)           INTERVAL(ms)
-
-
-/* extension mode */
+#define ED(key)         EXT_DOWN(KC_##key)
+#define EU(key)         EXT_UP(KC_##key)
+#define ET(key)         EXT_TYPE(KC_##key)
+#define TR(n)           TYPE_RUN(n)
 
 
 #endif /* ACTION_MACRO_H */
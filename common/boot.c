@@ -0,0 +1,81 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "print.h"
+#include "boot.h"
+
+
+#define PHASE_RUNNING   (1<<0)
+#define PHASE_DONE      (1<<1)
+
+static uint8_t  phase_state[BOOT_PHASES];
+static uint16_t phase_begin[BOOT_PHASES];
+static uint16_t phase_end[BOOT_PHASES];
+
+
+void boot_phase_begin(uint8_t id)
+{
+    phase_state[id] = PHASE_RUNNING;
+    phase_begin[id] = timer_read();
+}
+
+void boot_phase_end(uint8_t id)
+{
+    if (!(phase_state[id] & PHASE_RUNNING)) return;
+    phase_state[id] = PHASE_DONE;
+    phase_end[id] = timer_read();
+}
+
+bool boot_phase_running(uint8_t id)
+{
+    return phase_state[id] & PHASE_RUNNING;
+}
+
+bool boot_phase_done(uint8_t id)
+{
+    return phase_state[id] & PHASE_DONE;
+}
+
+uint16_t boot_phase_elapsed(uint8_t id)
+{
+    return timer_elapsed(phase_begin[id]);
+}
+
+void boot_print(void)
+{
+    static const char names[BOOT_PHASES][8] PROGMEM = {
+        [BOOT_MATRIX]       = "matrix",
+        [BOOT_PS2_MOUSE]    = "ps2",
+        [BOOT_USB]          = "usb",
+        [BOOT_MODULE]       = "module",
+    };
+
+    print("boot(ms) begin-end:\n");
+    for (uint8_t i = 0; i < BOOT_PHASES; i++) {
+        if (!phase_state[i]) continue;
+        print("  "); print_P(names[i]); print(": ");
+        pdec(phase_begin[i]); print("-");
+        if (phase_state[i] & PHASE_DONE) {
+            pdec(phase_end[i]);
+        } else {
+            print("running");
+        }
+        print("\n");
+    }
+}
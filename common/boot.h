@@ -0,0 +1,57 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Boot phases
+ *
+ * Nothing waits for a phase to finish with delay. Each phase is begun at
+ * init and ended later by main loop when its time has come or its device
+ * answers, so that phases overlap. Begin and end time(ms) of each are
+ * recorded and shown with command 's'.
+ */
+enum boot_phase_id {
+    BOOT_MATRIX = 0,    /* matrix debounce warm-up and boot magic keys */
+    BOOT_PS2_MOUSE,     /* PS/2 mouse reset and BAT */
+    BOOT_USB,           /* USB enumeration until configured */
+    BOOT_MODULE,        /* external module(iWRAP, USB host shield) */
+    BOOT_PHASES
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void boot_phase_begin(uint8_t id);
+/* no-op unless phase is running */
+void boot_phase_end(uint8_t id);
+bool boot_phase_running(uint8_t id);
+bool boot_phase_done(uint8_t id);
+/* time(ms) since phase began */
+uint16_t boot_phase_elapsed(uint8_t id);
+void boot_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,9 +27,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "keyboard.h"
 #include "bootloader.h"
 #include "command.h"
+#include "boot.h"
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
 #endif
+#ifdef SLEEP_ENABLE
+#include "sleep.h"
+#endif
+#ifdef PERF_ENABLE
+#include "perf.h"
+#endif
+#ifdef PROF_ENABLE
+#include "prof.h"
+#endif
 
 #ifdef HOST_PJRC
 #   include "usb_keyboard.h"
@@ -42,6 +52,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   include "usbdrv.h"
 #endif
 
+#ifdef HOST_LUFA
+#   include "lufa.h"
+#endif
+
 
 static bool command_common(uint8_t code);
 static void command_common_help(void);
@@ -106,6 +120,9 @@ static void command_common_help(void)
     print("v:	print device version & info\n");
     print("t:	print timer count\n");
     print("s:	print status\n");
+#if defined(PERF_ENABLE) || defined(PROF_ENABLE)
+    print("f:	print and reset perf counters and profile\n");
+#endif
 #ifdef NKRO_ENABLE
     print("n:	toggle NKRO\n");
 #endif
@@ -150,6 +167,7 @@ static bool command_common(uint8_t code)
             break;
         case KC_PAUSE:
             clear_keyboard();
+            host_flush_keyboard_report();
             print("\n\nJump to bootloader... ");
             _delay_ms(1000);
             bootloader_jump(); // not return
@@ -204,6 +222,16 @@ static bool command_common(uint8_t code)
         case KC_T: // print timer
             print_val_hex32(timer_count);
             break;
+#if defined(PERF_ENABLE) || defined(PROF_ENABLE)
+        case KC_F: // print perf counters and profile and start new session
+#   ifdef PERF_ENABLE
+            perf_print();
+#   endif
+#   ifdef PROF_ENABLE
+            prof_print();
+#   endif
+            break;
+#endif
         case KC_P: // print toggle
             if (print_enable) {
                 print("print disabled.\n");
@@ -216,6 +244,7 @@ static bool command_common(uint8_t code)
         case KC_S:
             print("\n\n----- Status -----\n");
             print_val_hex8(host_keyboard_leds());
+            boot_print();
 #ifdef HOST_PJRC
             print_val_hex8(UDCON);
             print_val_hex8(UDIEN);
@@ -230,11 +259,22 @@ static bool command_common(uint8_t code)
 #   if USB_COUNT_SOF
             print_val_hex8(usbSofCount);
 #   endif
+#endif
+
+#ifdef HOST_LUFA
+            print_val_hex16(lufa_keyboard_dropped);
+            print_val_hex16(lufa_mouse_dropped);
+            print_val_hex16(lufa_extra_dropped);
+#endif
+
+#ifdef SLEEP_ENABLE
+            sleep_print();
 #endif
             break;
 #ifdef NKRO_ENABLE
         case KC_N:
             clear_keyboard(); //Prevents stuck keys.
+            host_flush_keyboard_report();
             keyboard_nkro = !keyboard_nkro;
             if (keyboard_nkro)
                 print("NKRO: enabled\n");
@@ -543,9 +583,9 @@ static uint8_t numkey2num(uint8_t code)
 
 static void switch_layer(uint8_t layer)
 {
-    print_val_hex8(current_layer);
+    print_val_hex16(layer_state);
     print_val_hex8(default_layer);
-    current_layer = layer;
+    layer_state = 0;
     default_layer = layer;
     print("switch to "); print_val_hex8(layer);
 }
@@ -0,0 +1,253 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Debounce switch states of matrix
+ *
+ * Matrix code reads raw rows and passes them with time to debounce() instead
+ * of waiting for switches to settle. Time is compared with 8bit stamps so
+ * DEBOUNCE should be less than 255.
+ *
+ * DEBOUNCE_VCOUNTER is based on vertical counter debounce of
+ *      Peter Dannegger [danni/At/specs/d0t/de]
+ *      http://www.mikrocontroller.net/articles/Entprellung
+ * generalized to matrix_row_t and 2 to 4 bit counters.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "debounce.h"
+
+
+#if DEBOUNCE > 254
+#   error "DEBOUNCE should be less than 255"
+#endif
+
+#define ROW_BIT(col)    ((matrix_row_t)1<<(col))
+#define DIRTY_BIT(row)  ((matrix_dirty_t)1<<(row))
+
+/* rows changed since last matrix_dirty_rows() */
+static matrix_dirty_t dirty = 0;
+/* set by debounce_init() of matrix which uses this */
+static bool in_use = false;
+/* raw rows passed to debounce() */
+static matrix_row_t *raw_rows = 0;
+
+/* This module is linked to every board, so matrix which doesn't debounce
+ * with it still gets all rows as weak default in keyboard.c does and its
+ * own rows as raw rows. */
+matrix_dirty_t matrix_dirty_rows(void)
+{
+    if (!in_use) return MATRIX_DIRTY_ALL;
+    matrix_dirty_t d = dirty;
+    dirty = 0;
+    return d;
+}
+
+matrix_row_t matrix_raw_row(uint8_t row)
+{
+    if (!raw_rows) return matrix_get_row(row);
+    return raw_rows[row];
+}
+
+
+#if DEBOUNCE == 0
+void debounce_init(void)
+{
+    in_use = true;
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t debounced[], uint16_t time)
+{
+    raw_rows = raw;
+    matrix_dirty_t changed = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (debounced[r] != raw[r]) {
+            debounced[r] = raw[r];
+            changed |= DIRTY_BIT(r);
+        }
+    }
+    dirty |= changed;
+    return changed;
+}
+
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_SYM_DEFER
+/* raw rows of last call */
+static matrix_row_t raw_last[MATRIX_ROWS];
+/* time of last change of any switch */
+static uint16_t change_time;
+static bool settling;
+
+void debounce_init(void)
+{
+    in_use = true;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        raw_last[r] = 0;
+    }
+    settling = false;
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t debounced[], uint16_t time)
+{
+    raw_rows = raw;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (raw_last[r] != raw[r]) {
+            raw_last[r] = raw[r];
+            change_time = time;
+            settling = true;
+        }
+    }
+
+    if (!settling || (uint16_t)(time - change_time) < DEBOUNCE) {
+        return false;
+    }
+    settling = false;
+
+    matrix_dirty_t changed = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (debounced[r] != raw[r]) {
+            debounced[r] = raw[r];
+            changed |= DIRTY_BIT(r);
+        }
+    }
+    dirty |= changed;
+    return changed;
+}
+
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_PK_DEFER || DEBOUNCE_TYPE == DEBOUNCE_PK_EAGER
+/* keys being timed */
+static matrix_row_t counting[MATRIX_ROWS];
+/* lower 8bit of time when key started to be timed */
+static uint8_t stamp[MATRIX_ROWS][MATRIX_COLS];
+#if DEBOUNCE_TYPE == DEBOUNCE_PK_DEFER
+/* raw rows of last call */
+static matrix_row_t raw_last[MATRIX_ROWS];
+#endif
+
+void debounce_init(void)
+{
+    in_use = true;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        counting[r] = 0;
+#if DEBOUNCE_TYPE == DEBOUNCE_PK_DEFER
+        raw_last[r] = 0;
+#endif
+    }
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t debounced[], uint16_t time)
+{
+    raw_rows = raw;
+    matrix_dirty_t changed = 0;
+    uint8_t now = time & 0xFF;
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+#if DEBOUNCE_TYPE == DEBOUNCE_PK_DEFER
+        /* keys changed since last call restart timing and can't settle now */
+        matrix_row_t edge = raw[r] ^ raw_last[r];
+        raw_last[r] = raw[r];
+        matrix_row_t settle = counting[r] & ~edge;
+#else
+        matrix_row_t settle = counting[r];
+#endif
+        /* end timing of keys which have been stable for DEBOUNCE */
+        if (settle) {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                if ((settle & ROW_BIT(c)) && (uint8_t)(now - stamp[r][c]) >= DEBOUNCE) {
+                    counting[r] &= ~ROW_BIT(c);
+#if DEBOUNCE_TYPE == DEBOUNCE_PK_DEFER
+                    /* settled: take raw state, same since stamp */
+                    if ((debounced[r] ^ raw[r]) & ROW_BIT(c)) {
+                        debounced[r] ^= ROW_BIT(c);
+                        changed |= DIRTY_BIT(r);
+                    }
+#endif
+                }
+            }
+        }
+
+#if DEBOUNCE_TYPE != DEBOUNCE_PK_DEFER
+        /* report change of keys not locked out at once and lock them out */
+        matrix_row_t edge = (raw[r] ^ debounced[r]) & ~counting[r];
+        if (edge) {
+            debounced[r] ^= edge;
+            changed |= DIRTY_BIT(r);
+        }
+#endif
+        if (edge) {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                if (edge & ROW_BIT(c)) {
+                    stamp[r][c] = now;
+                }
+            }
+            /* (re)start timing of keys changed */
+            counting[r] |= edge;
+        }
+    }
+    dirty |= changed;
+    return changed;
+}
+
+#elif DEBOUNCE_TYPE == DEBOUNCE_VCOUNTER
+#if DEBOUNCE_VC_BITS < 2 || DEBOUNCE_VC_BITS > 4
+#   error "DEBOUNCE_VC_BITS should be 2, 3 or 4"
+#endif
+/* bit n of counters of all keys in a row: vc[n][row] */
+static matrix_row_t vc[DEBOUNCE_VC_BITS][MATRIX_ROWS];
+static uint8_t last_time;
+
+void debounce_init(void)
+{
+    in_use = true;
+    for (uint8_t n = 0; n < DEBOUNCE_VC_BITS; n++) {
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            vc[n][r] = 0;
+        }
+    }
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t debounced[], uint16_t time)
+{
+    raw_rows = raw;
+    /* sample once per 1ms */
+    if ((uint8_t)time == last_time) return false;
+    last_time = time;
+
+    matrix_dirty_t changed = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        /* count up keys differing from debounced state, reset others */
+        matrix_row_t delta = raw[r] ^ debounced[r];
+        matrix_row_t carry = delta;
+        for (uint8_t n = 0; n < DEBOUNCE_VC_BITS; n++) {
+            matrix_row_t c = vc[n][r];
+            vc[n][r] = (c ^ carry) & delta;
+            carry &= c;
+        }
+        /* carry out of counter: toggle debounced state */
+        if (carry) {
+            debounced[r] ^= carry;
+            changed |= DIRTY_BIT(r);
+        }
+    }
+    dirty |= changed;
+    return changed;
+}
+
+#else
+#   error "DEBOUNCE_TYPE: invalid value"
+#endif
@@ -0,0 +1,68 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+
+/* time(ms) for switch state to settle */
+#ifndef DEBOUNCE
+#   define DEBOUNCE     5
+#endif
+
+/* debounce algorithms */
+/* whole matrix: report changes after no switch changes for DEBOUNCE */
+#define DEBOUNCE_SYM_DEFER      0
+/* per key: report change after the switch has no change for DEBOUNCE */
+#define DEBOUNCE_PK_DEFER       1
+/* per key: report change at once then ignore the switch for DEBOUNCE */
+#define DEBOUNCE_PK_EAGER       2
+/* per key: vertical counters, report change after 2^DEBOUNCE_VC_BITS samples(1ms) in new state */
+#define DEBOUNCE_VCOUNTER       3
+
+#ifndef DEBOUNCE_TYPE
+#   define DEBOUNCE_TYPE    DEBOUNCE_SYM_DEFER
+#endif
+
+/* depth of vertical counters: 2, 3 or 4 bits, 4, 8 or 16 samples.
+ * DEBOUNCE is rounded up to power of two: 4, 8 or 16ms. */
+#ifndef DEBOUNCE_VC_BITS
+#   if DEBOUNCE <= 4
+#       define DEBOUNCE_VC_BITS     2
+#   elif DEBOUNCE <= 8
+#       define DEBOUNCE_VC_BITS     3
+#   else
+#       define DEBOUNCE_VC_BITS     4
+#   endif
+#endif
+
+
+/* forget all states, keys are released */
+void debounce_init(void);
+/*
+ * Update debounced rows from raw rows read at time(ms).
+ * Returns true when any row of debounced is changed.
+ * This never waits, call it every scan.
+ */
+bool debounce(matrix_row_t raw[], matrix_row_t debounced[], uint16_t time);
+/* matrix_dirty_rows() in matrix.h is defined here: rows changed by debounce()
+ * since last call */
+
+#endif
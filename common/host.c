@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 #include "util.h"
 #include "debug.h"
+#include "perf.h"
+#include "prof.h"
 
 
 #ifdef NKRO_ENABLE
@@ -35,6 +37,51 @@ static host_driver_t *driver;
 static uint16_t last_system_report = 0;
 static uint16_t last_consumer_report = 0;
 
+/* keyboard report batching
+ *
+ * host_send_keyboard_report() only marks report to send and
+ * host_flush_keyboard_report() sends it once per keyboard_task().
+ * Changes in same direction(press or release) are merged into one report.
+ * A change reversing unsent one flushes report first so that host never
+ * misses a press or release.
+ */
+#define REPORT_ADDED    (1<<0)
+#define REPORT_DELETED  (1<<1)
+static bool keyboard_report_dirty = false;
+static uint8_t keyboard_report_changes = 0;
+
+/* key slot bookkeeping
+ *
+ * keys_count is number of keys in report, keys_slots has a bit for each used
+ * byte of keys[] in 6KRO mode and keys_bits has a bit for each keycode in
+ * report, so that add, any-key and first-key don't scan the report.
+ * Delete still looks for slot of the key in REPORT_BYTE_KEYS bytes, only when
+ * keys_bits has it. Index from keycode to slot would take 256 bytes of RAM.
+ * Report itself is kept in wire format.
+ */
+#if REPORT_BYTE_KEYS <= 8
+typedef uint8_t keys_slots_t;
+#   define SLOT_BITON(bits)     biton(bits)
+#elif REPORT_BYTE_KEYS <= 16
+typedef uint16_t keys_slots_t;
+#   define SLOT_BITON(bits)     biton16(bits)
+#elif REPORT_BYTE_KEYS <= 32
+typedef uint32_t keys_slots_t;
+#   define SLOT_BITON(bits)     biton32(bits)
+#else
+#   error "REPORT_BYTE_KEYS should be 32 or less for keys_slots"
+#endif
+#define KEYS_SLOTS_FULL     ((keys_slots_t)((1ULL<<REPORT_BYTE_KEYS) - 1))
+#define KEYS_SLOT(i)        ((keys_slots_t)1<<(i))
+
+static uint8_t keys_count = 0;
+static keys_slots_t keys_slots = 0;
+static uint8_t keys_bits[32];
+
+#define KEY_BIT(code)       (1<<((code)&7))
+#define HAS_KEY_BIT(code)   (keys_bits[(code)>>3] & KEY_BIT(code))
+
+static inline void report_change(uint8_t change);
 static inline void add_key_byte(uint8_t code);
 static inline void del_key_byte(uint8_t code);
 static inline void add_key_bit(uint8_t code);
@@ -43,6 +90,8 @@ static inline void del_key_bit(uint8_t code);
 
 void host_set_driver(host_driver_t *d)
 {
+    // report changed in this task goes to driver it was made for
+    host_flush_keyboard_report();
     driver = d;
 }
 
@@ -60,7 +109,10 @@ uint8_t host_keyboard_leds(void)
 void host_keyboard_send(report_keyboard_t *report)
 {
     if (!driver) return;
+    PROF_BEGIN(PROF_HOST_KEYBOARD_SEND);
     (*driver->send_keyboard)(report);
+    PROF_END(PROF_HOST_KEYBOARD_SEND);
+    PERF_COUNT(PERF_REPORT_KEYBOARD);
 
     if (debug_keyboard) {
         print("keys: ");
@@ -75,6 +127,7 @@ void host_mouse_send(report_mouse_t *report)
 {
     if (!driver) return;
     (*driver->send_mouse)(report);
+    PERF_COUNT(PERF_REPORT_MOUSE);
 }
 
 void host_system_send(uint16_t report)
@@ -84,6 +137,7 @@ void host_system_send(uint16_t report)
 
     if (!driver) return;
     (*driver->send_system)(report);
+    PERF_COUNT(PERF_REPORT_SYSTEM);
 }
 
 void host_consumer_send(uint16_t report)
@@ -93,6 +147,7 @@ void host_consumer_send(uint16_t report)
 
     if (!driver) return;
     (*driver->send_consumer)(report);
+    PERF_COUNT(PERF_REPORT_CONSUMER);
 }
 
 
@@ -100,6 +155,7 @@ void host_consumer_send(uint16_t report)
 /* keyboard report utils */
 void host_add_key(uint8_t key)
 {
+    report_change(REPORT_ADDED);
 #ifdef NKRO_ENABLE
     if (keyboard_nkro) {
         add_key_bit(key);
@@ -111,6 +167,7 @@ void host_add_key(uint8_t key)
 
 void host_del_key(uint8_t key)
 {
+    report_change(REPORT_DELETED);
 #ifdef NKRO_ENABLE
     if (keyboard_nkro) {
         del_key_bit(key);
@@ -122,11 +179,30 @@ void host_del_key(uint8_t key)
 
 void host_clear_keys(void)
 {
+    report_change(REPORT_DELETED);
     for (int8_t i = 0; i < REPORT_KEYS; i++) {
         keyboard_report->keys[i] = 0;
     }
+    for (uint8_t i = 0; i < sizeof(keys_bits); i++) {
+        keys_bits[i] = 0;
+    }
+    keys_slots = 0;
+    keys_count = 0;
 }
 
+#ifdef NKRO_ENABLE
+void host_boot_protocol(void)
+{
+    if (!keyboard_nkro) return;
+    // pending report goes in NKRO format it was made in
+    host_flush_keyboard_report();
+    keyboard_nkro = false;
+    host_clear_keys();
+    host_send_keyboard_report();
+    host_flush_keyboard_report();
+}
+#endif
+
 uint8_t host_get_mods(void)
 {
     return keyboard_report->mods;
@@ -134,32 +210,32 @@ uint8_t host_get_mods(void)
 
 void host_add_mods(uint8_t mods)
 {
+    report_change(REPORT_ADDED);
     keyboard_report->mods |= mods;
 }
 
 void host_del_mods(uint8_t mods)
 {
+    report_change(REPORT_DELETED);
     keyboard_report->mods &= ~mods;
 }
 
 void host_set_mods(uint8_t mods)
 {
+    if (mods & ~keyboard_report->mods) report_change(REPORT_ADDED);
+    if (keyboard_report->mods & ~mods) report_change(REPORT_DELETED);
     keyboard_report->mods = mods;
 }
 
 void host_clear_mods(void)
 {
+    report_change(REPORT_DELETED);
     keyboard_report->mods = 0;
 }
 
 uint8_t host_has_anykey(void)
 {
-    uint8_t cnt = 0;
-    for (int i = 0; i < REPORT_KEYS; i++) {
-        if (keyboard_report->keys[i])
-            cnt++;
-    }
-    return cnt;
+    return keys_count;
 }
 
 uint8_t host_has_anymod(void)
@@ -169,20 +245,35 @@ uint8_t host_has_anymod(void)
 
 uint8_t host_get_first_key(void)
 {
+    if (!keys_count) return 0;
 #ifdef NKRO_ENABLE
     if (keyboard_nkro) {
         uint8_t i = 0;
         for (; i < REPORT_KEYS && !keyboard_report->keys[i]; i++)
             ;
-        return i<<3 | biton(keyboard_report->keys[i]);
+        uint8_t bits = keyboard_report->keys[i];
+        return i<<3 | biton(bits & -bits);
     }
 #endif
-    return keyboard_report->keys[0];
+    // lowest used slot
+    return keyboard_report->keys[SLOT_BITON(keys_slots & -keys_slots)];
 }
 
 void host_send_keyboard_report(void)
 {
     if (!driver) return;
+#ifdef NO_REPORT_BATCH
+    host_keyboard_send(keyboard_report);
+#else
+    keyboard_report_dirty = true;
+#endif
+}
+
+void host_flush_keyboard_report(void)
+{
+    keyboard_report_changes = 0;
+    if (!keyboard_report_dirty) return;
+    keyboard_report_dirty = false;
     host_keyboard_send(keyboard_report);
 }
 
@@ -201,39 +292,48 @@ uint16_t host_last_consumer_report(void)
     return last_consumer_report;
 }
 
-static inline void add_key_byte(uint8_t code)
+static inline void report_change(uint8_t change)
 {
-    int8_t i = 0;
-    int8_t empty = -1;
-    for (; i < REPORT_KEYS; i++) {
-        if (keyboard_report->keys[i] == code) {
-            break;
-        }
-        if (empty == -1 && keyboard_report->keys[i] == 0) {
-            empty = i;
-        }
-    }
-    if (i == REPORT_KEYS) {
-        if (empty != -1) {
-            keyboard_report->keys[empty] = code;
-        }
+    if (keyboard_report_changes & ~change) {
+        host_flush_keyboard_report();
     }
+    keyboard_report_changes |= change;
+}
+
+static inline void add_key_byte(uint8_t code)
+{
+    if (!code || HAS_KEY_BIT(code)) return;
+    if (keys_slots == KEYS_SLOTS_FULL) return;              // no room
+
+    keys_slots_t empty = ~keys_slots & (keys_slots + 1);    // lowest free slot
+    keyboard_report->keys[SLOT_BITON(empty)] = code;
+    keys_slots |= empty;
+    keys_bits[code>>3] |= KEY_BIT(code);
+    keys_count++;
 }
 
 static inline void del_key_byte(uint8_t code)
 {
-    int i = 0;
-    for (; i < REPORT_KEYS; i++) {
+    if (!HAS_KEY_BIT(code)) return;
+
+    // bounded scan of REPORT_BYTE_KEYS(6) bytes for slot of the key
+    for (uint8_t i = 0; i < REPORT_BYTE_KEYS; i++) {
         if (keyboard_report->keys[i] == code) {
             keyboard_report->keys[i] = 0;
+            keys_slots &= ~KEYS_SLOT(i);
+            break;
         }
     }
+    keys_bits[code>>3] &= ~KEY_BIT(code);
+    keys_count--;
 }
 
 static inline void add_key_bit(uint8_t code)
 {
     if ((code>>3) < REPORT_KEYS) {
-        keyboard_report->keys[code>>3] |= 1<<(code&7);
+        if (keyboard_report->keys[code>>3] & KEY_BIT(code)) return;
+        keyboard_report->keys[code>>3] |= KEY_BIT(code);
+        keys_count++;
     } else {
         debug("add_key_bit: can't add: "); phex(code); debug("\n");
     }
@@ -242,7 +342,9 @@ static inline void add_key_bit(uint8_t code)
 static inline void del_key_bit(uint8_t code)
 {
     if ((code>>3) < REPORT_KEYS) {
-        keyboard_report->keys[code>>3] &= ~(1<<(code&7));
+        if (!(keyboard_report->keys[code>>3] & KEY_BIT(code))) return;
+        keyboard_report->keys[code>>3] &= ~KEY_BIT(code);
+        keys_count--;
     } else {
         debug("del_key_bit: can't del: "); phex(code); debug("\n");
     }
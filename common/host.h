@@ -62,7 +62,14 @@ void host_clear_mods(void);
 uint8_t host_has_anykey(void);
 uint8_t host_has_anymod(void);
 uint8_t host_get_first_key(void);
+#ifdef NKRO_ENABLE
+/* host set boot protocol: leave NKRO and send boot report with keys released */
+void host_boot_protocol(void);
+#endif
+/* mark report to be sent by next flush(at once with NO_REPORT_BATCH) */
 void host_send_keyboard_report(void);
+/* send report now if marked. keyboard_task() calls this once per loop */
+void host_flush_keyboard_report(void);
 
 /* mouse report utils */
 uint8_t host_mouse_in_use(void);
@@ -15,6 +15,8 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include "keyboard.h"
 #include "matrix.h"
@@ -29,9 +31,181 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "sendchar.h"
 #include "bootloader.h"
+#include "perf.h"
+#include "prof.h"
+#include "boot.h"
+#include "action_macro.h"
+#ifdef MATRIX_SCAN_PIPELINE
+#include "matrix_pipeline.h"
+#endif
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
 #endif
+#ifdef PS2_MOUSE_ENABLE
+#include "ps2_mouse.h"
+#endif
+
+
+/* number of matrix changes turned into events per keyboard_task() call */
+#ifndef KEYS_PER_SCAN
+#   define KEYS_PER_SCAN    1
+#endif
+
+static matrix_row_t matrix_prev[MATRIX_ROWS];
+/* rows which may differ from matrix_prev */
+static matrix_dirty_t matrix_dirty = 0;
+
+/* index of a single on-bit of row or column */
+#if (MATRIX_ROWS <= 8)
+#   define ROW_INDEX(bit)   biton(bit)
+#elif (MATRIX_ROWS <= 16)
+#   define ROW_INDEX(bit)   biton16(bit)
+#else
+#   define ROW_INDEX(bit)   biton32(bit)
+#endif
+#if (MATRIX_COLS <= 8)
+#   define COL_INDEX(bit)   biton(bit)
+#elif (MATRIX_COLS <= 16)
+#   define COL_INDEX(bit)   biton16(bit)
+#else
+#   define COL_INDEX(bit)   biton32(bit)
+#endif
+
+/*
+ * Deadline of timed jobs
+ *
+ * action_exec(TICK), action_macro_task() and mousekey_task() are run only
+ * when their deadline has come or key events are processed, not on every
+ * idle loop.
+ */
+static bool deadline_set = true;
+static uint16_t deadline = 0;
+
+static void deadline_update(void)
+{
+    uint16_t wait = action_deadline();
+    uint16_t macro_wait = action_macro_deadline();
+    if (macro_wait < wait) wait = macro_wait;
+#ifdef MOUSEKEY_ENABLE
+    uint16_t mousekey_wait = mousekey_deadline();
+    if (mousekey_wait < wait) wait = mousekey_wait;
+#endif
+    deadline_set = (wait != TIMER_NO_DEADLINE);
+    deadline = timer_read() + wait;
+}
+
+static bool deadline_expired(void)
+{
+    return deadline_set && (int16_t)(timer_read() - deadline) >= 0;
+}
+
+/* matrix which doesn't track changed rows: look at all rows every scan */
+__attribute__ ((weak))
+matrix_dirty_t matrix_dirty_rows(void)
+{
+    return MATRIX_DIRTY_ALL;
+}
+
+#ifdef MATRIX_SCAN_ISR
+/* matrix_scan() runs in timer ISR, it should read a row without waiting for
+ * it to settle. Simulated matrix of native build doesn't wait. */
+#if !defined(MATRIX_SCAN_PIPELINE) && !defined(HOST_NATIVE)
+#   error "MATRIX_SCAN_ISR needs matrix with MATRIX_SCAN_PIPELINE"
+#endif
+
+/*
+ * Key event queue
+ *
+ * keyboard_scan() in timer ISR puts changes with time they are found and
+ * keyboard_task() gets them. Single producer and single consumer, ISR owns
+ * head and keyboard_task() owns tail.
+ */
+#ifndef KEY_QUEUE_SIZE
+#   define KEY_QUEUE_SIZE   16
+#endif
+static keyevent_t key_queue[KEY_QUEUE_SIZE];
+static volatile uint8_t key_queue_head = 0;
+static volatile uint8_t key_queue_tail = 0;
+static volatile bool scan_enabled = false;
+
+static bool key_queue_put(keyevent_t event)
+{
+    uint8_t next = (key_queue_head + 1) % KEY_QUEUE_SIZE;
+    if (next == key_queue_tail) return false;
+    key_queue[key_queue_head] = event;
+    key_queue_head = next;
+    return true;
+}
+
+static bool key_queue_get(keyevent_t *event)
+{
+    bool got = false;
+    uint8_t sreg = SREG;
+    cli();
+    if (key_queue_tail != key_queue_head) {
+        *event = key_queue[key_queue_tail];
+        key_queue_tail = (key_queue_tail + 1) % KEY_QUEUE_SIZE;
+        got = true;
+    }
+    SREG = sreg;
+    return got;
+}
+
+/*
+ * Scan matrix and queue changes with current time.
+ * This is called from timer ISR every 1ms.
+ * Change not queued for full queue is left in matrix_prev and found again
+ * in next scan.
+ */
+void keyboard_scan(void)
+{
+    if (!scan_enabled) return;
+
+    PROF_BEGIN(PROF_MATRIX_SCAN);
+    uint8_t scanned = matrix_scan();
+    PROF_END(PROF_MATRIX_SCAN);
+    if (scanned) PERF_COUNT(PERF_SCAN);
+    matrix_dirty |= matrix_dirty_rows();
+    /* interrupts are enabled here and nested tick can change timer_count */
+    uint16_t time = timer_read() | 1; /* time should not be 0 */
+    while (matrix_dirty) {
+        matrix_dirty_t row_bit = matrix_dirty & -matrix_dirty;
+        uint8_t r = ROW_INDEX(row_bit);
+        matrix_row_t matrix_row = matrix_get_row(r);
+        matrix_row_t matrix_change = matrix_row ^ matrix_prev[r];
+        while (matrix_change) {
+            matrix_row_t col_bit = matrix_change & -matrix_change;
+            if (!key_queue_put((keyevent_t){
+                    .key = (key_t){ .row = r, .col = COL_INDEX(col_bit) },
+                    .pressed = (matrix_row & col_bit),
+                    .time = time })) {
+                return;
+            }
+            matrix_prev[r] ^= col_bit;
+            matrix_change ^= col_bit;
+        }
+        matrix_dirty &= ~row_bit;
+    }
+}
+#endif
+
+uint16_t keyboard_deadline(void)
+{
+#ifdef MATRIX_SCAN_ISR
+    // events left in queue over KEYS_PER_SCAN
+    if (key_queue_tail != key_queue_head) return 0;
+#else
+    // changes left over KEYS_PER_SCAN
+    if (matrix_dirty) return 0;
+#endif
+#ifdef MATRIX_SCAN_PIPELINE
+    // rest of rows are read in following calls
+    if (matrix_pipeline_busy()) return 0;
+#endif
+    if (!deadline_set) return TIMER_NO_DEADLINE;
+    int16_t wait = deadline - timer_read();
+    return (wait > 0 ? wait : 0);
+}
 
 
 void keyboard_init(void)
@@ -41,13 +215,45 @@ void keyboard_init(void)
 
     timer_init();
     matrix_init();
+    boot_phase_begin(BOOT_MATRIX);
+
+#ifdef PS2_MOUSE_ENABLE
+    /* rest of init is done after BAT in keyboard_task() */
+    boot_phase_begin(BOOT_PS2_MOUSE);
+    ps2_mouse_init();
+#endif
+
+#ifdef PROF_ENABLE
+    prof_init();
+#endif
+}
+
+/*
+ * Boot phases run by keyboard_task() instead of waiting in keyboard_init().
+ * Keys are not processed until matrix is scanned for DEBOUNCE*2 ms and
+ * boot magic keys are checked, keys held at boot are processed after that.
+ * Returns true while any phase is running.
+ */
+static bool keyboard_boot_task(void)
+{
+    bool running = false;
+
+#ifdef PS2_MOUSE_ENABLE
+    if (boot_phase_running(BOOT_PS2_MOUSE)) {
+        if (ps2_mouse_init_task()) {
+            boot_phase_end(BOOT_PS2_MOUSE);
+        } else {
+            running = true;
+        }
+    }
+#endif
+
+    if (boot_phase_done(BOOT_MATRIX)) return running;
 
     /* matrix scan for boot magic keys */
+    if (!matrix_scan()) return true;
 #ifdef DEBOUNCE
-    uint8_t scan = DEBOUNCE * 2;
-    while (scan--) { matrix_scan(); _delay_ms(1); }
-#else
-    matrix_scan();
+    if (boot_phase_elapsed(BOOT_MATRIX) < DEBOUNCE * 2) return true;
 #endif
 
     /* boot magic keys */
@@ -59,57 +265,111 @@ void keyboard_init(void)
     if (IS_BOOTMAGIC_DEBUG()) debug_enable = true;
 #endif
 
-#ifdef PS2_MOUSE_ENABLE
-    ps2_mouse_init();
+#ifdef MATRIX_SCAN_ISR
+    scan_enabled = true;
 #endif
+    boot_phase_end(BOOT_MATRIX);
+    return running;
 }
 
 /*
  * Do keyboard routine jobs: scan mantrix, light LEDs, ...
  * This is repeatedly called as fast as possible.
+ *
+ * Changed keys are turned into events in row then column order, up to
+ * KEYS_PER_SCAN per call. The rest are picked up in following calls.
+ * Only rows reported by matrix_dirty_rows() are looked at, and only
+ * changed bits of them.
+ * With MATRIX_SCAN_ISR events are taken from queue filled by keyboard_scan()
+ * instead, they have time when change is found in timer ISR.
+ * Without events TICK, macro and mousekey are run only at their deadline.
+ * Until boot phases are over keyboard_boot_task() is run first.
  */
 void keyboard_task(void)
 {
-    static matrix_row_t matrix_prev[MATRIX_ROWS];
     static uint8_t led_status = 0;
-    matrix_row_t matrix_row = 0;
-    matrix_row_t matrix_change = 0;
-
-    matrix_scan();
-    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
-        matrix_row = matrix_get_row(r);
-        matrix_change = matrix_row ^ matrix_prev[r];
-        if (matrix_change) {
-            if (debug_matrix) matrix_print();
-
-            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
-                if (matrix_change & ((matrix_row_t)1<<c)) {
-                    action_exec((keyevent_t){
-                        .key = (key_t){ .row = r, .col = c },
-                        .pressed = (matrix_row & (1<<c)),
-                        .time = (timer_read() | 1) /* time should not be 0 */
-                    });
-                    // record a processed key
-                    matrix_prev[r] ^= ((matrix_row_t)1<<c);
-                    // process a key per task call
-                    goto MATRIX_LOOP_END;
-                }
+    static bool booting = true;
+    uint8_t keys_processed = 0;
+
+    if (booting) {
+        booting = keyboard_boot_task();
+        if (!boot_phase_done(BOOT_MATRIX)) return;
+    }
+
+    PROF_BEGIN(PROF_KEYBOARD_TASK);
+    PERF_TASK_BEGIN();
+    PERF_COUNT(PERF_TASK);
+
+#ifdef MATRIX_SCAN_ISR
+    keyevent_t event;
+    while (keys_processed < KEYS_PER_SCAN && key_queue_get(&event)) {
+        action_exec(event);
+        keys_processed++;
+    }
+    if (!keys_processed && deadline_expired()) {
+        action_exec(TICK);
+    }
+#else
+    PROF_BEGIN(PROF_MATRIX_SCAN);
+    uint8_t scanned = matrix_scan();
+    PROF_END(PROF_MATRIX_SCAN);
+    if (scanned) PERF_COUNT(PERF_SCAN);
+    matrix_dirty |= matrix_dirty_rows();
+    while (matrix_dirty) {
+        matrix_dirty_t row_bit = matrix_dirty & -matrix_dirty;
+        uint8_t r = ROW_INDEX(row_bit);
+        matrix_row_t matrix_row = matrix_get_row(r);
+        matrix_row_t matrix_change = matrix_row ^ matrix_prev[r];
+        if (matrix_change && debug_matrix) matrix_print();
+
+        while (matrix_change) {
+            matrix_row_t col_bit = matrix_change & -matrix_change;
+            action_exec((keyevent_t){
+                .key = (key_t){ .row = r, .col = COL_INDEX(col_bit) },
+                .pressed = (matrix_row & col_bit),
+                .time = (timer_read() | 1) /* time should not be 0 */
+            });
+            // record a processed key
+            matrix_prev[r] ^= col_bit;
+            matrix_change ^= col_bit;
+            if (++keys_processed >= KEYS_PER_SCAN) {
+                goto MATRIX_LOOP_END;
             }
         }
+        matrix_dirty &= ~row_bit;
+    }
+    // call with pseudo tick event when no real key event and deadline has come.
+    if (!keys_processed && deadline_expired()) {
+        action_exec(TICK);
     }
-    // call with pseudo tick event when no real key event.
-    action_exec(TICK);
 
 MATRIX_LOOP_END:
+#endif
+    // a step of macro playing, its report goes with this task
+    if (keys_processed || deadline_expired()) {
+        action_macro_task();
+    }
+
+    // send keyboard report changed in this task at once
+    host_flush_keyboard_report();
+
+    // timed jobs and their next deadline
+    if (keys_processed || deadline_expired()) {
 #ifdef MOUSEKEY_ENABLE
-    // mousekey repeat & acceleration
-    mousekey_task();
+        // mousekey repeat & acceleration
+        mousekey_task();
 #endif
+        deadline_update();
+    }
+
     // update LED
     if (led_status != host_keyboard_leds()) {
         led_status = host_keyboard_leds();
         keyboard_set_leds(led_status);
     }
+
+    PERF_TASK_END();
+    PROF_END(PROF_KEYBOARD_TASK);
 }
 
 void keyboard_set_leds(uint8_t leds)
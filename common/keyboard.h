@@ -61,7 +61,12 @@ typedef struct {
 
 void keyboard_init(void);
 void keyboard_task(void);
+/* scan matrix and queue events, called from timer ISR with MATRIX_SCAN_ISR */
+void keyboard_scan(void);
 void keyboard_set_leds(uint8_t leds);
+/* wait(ms) till keyboard_task() has timed job without key event, TIMER_NO_DEADLINE when idle.
+ * 0 while matrix changes or rows of pipelined scan are left to next call. */
+uint16_t keyboard_deadline(void);
 
 #ifdef __cplusplus
 }
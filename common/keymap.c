@@ -82,3 +82,9 @@ __attribute__ ((weak))
 void action_function(keyrecord_t *event, uint8_t id, uint8_t opt)
 {
 }
+
+__attribute__ ((weak))
+uint16_t keymap_tapping_term(uint8_t layer, key_t key)
+{
+    return 0;
+}
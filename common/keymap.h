@@ -29,6 +29,8 @@ uint8_t keymap_key_to_keycode(uint8_t layer, key_t key);
 action_t keymap_keycode_to_action(uint8_t keycode);
 /* translates Fn keycode to action */
 action_t keymap_fn_to_action(uint8_t keycode);
+/* tapping term(ms) of tap key on layer, 0 for TAPPING_TERM(TAPPING_TERM_PER_KEY) */
+uint16_t keymap_tapping_term(uint8_t layer, key_t key);
 
 
 
@@ -32,6 +32,18 @@ typedef  uint32_t   matrix_row_t;
 #error "MATRIX_COLS: invalid value"
 #endif
 
+/* bit per row */
+#if (MATRIX_ROWS <= 8)
+typedef  uint8_t    matrix_dirty_t;
+#elif (MATRIX_ROWS <= 16)
+typedef  uint16_t   matrix_dirty_t;
+#elif (MATRIX_ROWS <= 32)
+typedef  uint32_t   matrix_dirty_t;
+#else
+#error "MATRIX_ROWS: invalid value"
+#endif
+#define MATRIX_DIRTY_ALL    ((matrix_dirty_t)~(matrix_dirty_t)0 >> (sizeof(matrix_dirty_t)*8 - MATRIX_ROWS))
+
 #define MATRIX_IS_ON(row, col)  (matrix_get_row(row) && (1<<col))
 
 
@@ -41,20 +53,28 @@ uint8_t matrix_rows(void);
 uint8_t matrix_cols(void);
 /* intialize matrix for scaning. should be called once. */
 void matrix_init(void);
-/* scan all key states on matrix */
+/* scan all key states on matrix. returns 0 while pipelined scan is partway through rows. */
 uint8_t matrix_scan(void);
 /* whether modified from previous scan. used after matrix_scan. */
 bool matrix_is_modified(void);
+/* rows changed since last call. MATRIX_DIRTY_ALL by default for matrix which doesn't track rows. */
+matrix_dirty_t matrix_dirty_rows(void);
 /* whether ghosting occur on matrix. */
 bool matrix_has_ghost(void);
 /* whether a swtich is on */
 bool matrix_is_on(uint8_t row, uint8_t col);
 /* matrix state on row */
 matrix_row_t  matrix_get_row(uint8_t row);
+/* state on row before debounce, read by last scan. matrix_get_row() for matrix not using common/debounce.c. */
+matrix_row_t  matrix_raw_row(uint8_t row);
 /* count keys pressed */
 uint8_t matrix_key_count(void);
 /* print matrix for debug */
 void matrix_print(void);
+/* drive all rows and arm pin change interrupt on columns before power down. no-op by default. */
+void matrix_power_down(void);
+/* restore scan state after wake up. no-op by default. */
+void matrix_power_up(void);
 
 
 #endif
@@ -0,0 +1,154 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MATRIX_PINS_H
+#define MATRIX_PINS_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include "matrix.h"
+
+
+/* Pin map of matrix declared in config.h
+ *
+ *     #define MATRIX_ROW_PINS(X, a) \
+ *         X(0, D, 0, a) X(1, D, 1, a) X(2, D, 2, a) ...
+ *     #define MATRIX_COL_PINS(X, a) \
+ *         X(0, F, 0, a) X(1, F, 1, a) X(2, E, 6, a) ...
+ *
+ * X(row or column, port letter, bit, a) for each line of matrix.
+ * Row is selected with output low(DDR:1, PORT:0) and unselected with Hi-Z(DDR:0, PORT:0).
+ * Column is input with pull-up(DDR:0, PORT:1) and read as 1 when key is on.
+ *
+ * Each port is read once for columns. Bits of a port which move by the same distance
+ * fold into one mask and shift at compile time, so contiguous pins cost as much as one.
+ */
+#if !defined(MATRIX_ROW_PINS) || !defined(MATRIX_COL_PINS)
+#   error "MATRIX_ROW_PINS and MATRIX_COL_PINS are needed in config.h"
+#endif
+
+#define MATRIX_PORT_A   0
+#define MATRIX_PORT_B   1
+#define MATRIX_PORT_C   2
+#define MATRIX_PORT_D   3
+#define MATRIX_PORT_E   4
+#define MATRIX_PORT_F   5
+
+/* bits of 'port' in pin map */
+#define MATRIX_PIN_MASK(i, p, b, port)  | (MATRIX_PORT_##p == MATRIX_PORT_##port ? (1<<(b)) : 0)
+#define MATRIX_ROW_MASK(port)   ((uint8_t)(0 MATRIX_ROW_PINS(MATRIX_PIN_MASK, port)))
+#define MATRIX_COL_MASK(port)   ((uint8_t)(0 MATRIX_COL_PINS(MATRIX_PIN_MASK, port)))
+
+/* bit 'b' of port value 'v' moved to column 'i' */
+#define MATRIX_PIN_MOVE(v, b, i)    ((i) >= (b) ? \
+        (matrix_row_t)((v) & (1<<(b))) << ((i) >= (b) ? (i) - (b) : 0) : \
+        (matrix_row_t)((v) & (1<<(b))) >> ((i) <  (b) ? (b) - (i) : 0))
+#define MATRIX_COL_MOVE(i, p, b, port)  | (MATRIX_PORT_##p == MATRIX_PORT_##port ? MATRIX_PIN_MOVE(pin, b, i) : 0)
+
+#define MATRIX_COL_READ(port) \
+    if (MATRIX_COL_MASK(port)) { \
+        uint8_t pin = ~PIN##port; \
+        cols |= 0 MATRIX_COL_PINS(MATRIX_COL_MOVE, port); \
+    }
+#define MATRIX_COL_INIT(port) \
+    if (MATRIX_COL_MASK(port)) { \
+        DDR##port  &= (uint8_t)~MATRIX_COL_MASK(port); \
+        PORT##port |= MATRIX_COL_MASK(port); \
+    }
+#define MATRIX_ROW_UNSELECT(port) \
+    if (MATRIX_ROW_MASK(port)) { \
+        DDR##port  &= (uint8_t)~MATRIX_ROW_MASK(port); \
+        PORT##port &= (uint8_t)~MATRIX_ROW_MASK(port); \
+    }
+#define MATRIX_ROW_SELECT_ALL(port) \
+    if (MATRIX_ROW_MASK(port)) { \
+        DDR##port  |= MATRIX_ROW_MASK(port); \
+        PORT##port &= (uint8_t)~MATRIX_ROW_MASK(port); \
+    }
+#define MATRIX_ROW_SELECT(i, p, b, a) \
+    case i: \
+        DDR##p  |=  (1<<(b)); \
+        PORT##p &= ~(1<<(b)); \
+        break;
+
+/* call MATRIX_COL_READ and the like for each port of the MCU */
+#ifdef PORTA
+#   define MATRIX_PORT_A_DO(f)  f(A)
+#else
+#   define MATRIX_PORT_A_DO(f)
+#endif
+#ifdef PORTE
+#   define MATRIX_PORT_E_DO(f)  f(E)
+#else
+#   define MATRIX_PORT_E_DO(f)
+#endif
+#ifdef PORTF
+#   define MATRIX_PORT_F_DO(f)  f(F)
+#else
+#   define MATRIX_PORT_F_DO(f)
+#endif
+#define MATRIX_PORTS_DO(f) \
+    MATRIX_PORT_A_DO(f) f(B) f(C) f(D) MATRIX_PORT_E_DO(f) MATRIX_PORT_F_DO(f)
+
+
+static inline void matrix_pins_init_cols(void)
+{
+    MATRIX_PORTS_DO(MATRIX_COL_INIT)
+}
+
+static inline matrix_row_t matrix_pins_read_cols(void)
+{
+    matrix_row_t cols = 0;
+    MATRIX_PORTS_DO(MATRIX_COL_READ)
+    return cols;
+}
+
+static inline void matrix_pins_unselect_rows(void)
+{
+    MATRIX_PORTS_DO(MATRIX_ROW_UNSELECT)
+}
+
+static inline void matrix_pins_select_row(uint8_t row)
+{
+    switch (row) {
+        MATRIX_ROW_PINS(MATRIX_ROW_SELECT, 0)
+    }
+}
+
+/* Select all rows so that any key pulls its column low, and wake on pin change
+ * of columns on PORTB(PCINT0-7). Columns on other ports rely on watchdog wake. */
+static inline void matrix_pins_power_down(void)
+{
+    MATRIX_PORTS_DO(MATRIX_ROW_SELECT_ALL)
+#ifdef PCMSK0
+    PCMSK0 = MATRIX_COL_MASK(B);
+    if (MATRIX_COL_MASK(B)) {
+        PCIFR = (1<<PCIF0);
+        PCICR |= (1<<PCIE0);
+    }
+#endif
+}
+
+static inline void matrix_pins_power_up(void)
+{
+#ifdef PCMSK0
+    PCICR &= ~(1<<PCIE0);
+    PCMSK0 = 0;
+#endif
+    matrix_pins_unselect_rows();
+}
+
+#endif
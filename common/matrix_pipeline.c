@@ -0,0 +1,59 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Pipelined matrix scan for MATRIX_SCAN_PIPELINE
+ *
+ * One row is read per matrix_scan() and next row is selected right after,
+ * MATRIX_SETTLE_US passes while keyboard does other works. Time is checked
+ * with TIMER_RAW, so it never waits and can run in timer ISR.
+ */
+#include <stdint.h>
+#include <avr/io.h>
+#include "timer.h"
+#include "matrix.h"
+#include "matrix_pipeline.h"
+
+
+#ifdef MATRIX_SCAN_PIPELINE
+/* row selected on last call and TIMER_RAW when selected */
+static uint8_t scan_row = 0;
+static uint8_t select_raw;
+
+void matrix_pipeline_select(const matrix_pipeline_t *board)
+{
+    board->select_row(scan_row);
+    select_raw = TIMER_RAW;
+}
+
+uint8_t matrix_pipeline_scan(const matrix_pipeline_t *board, matrix_row_t raw[])
+{
+    if (TIMER_DIFF_RAW(TIMER_RAW, select_raw) <= TIMER_RAW_US(MATRIX_SETTLE_US)) {
+        return MATRIX_PIPELINE_SETTLING;
+    }
+    raw[scan_row] = board->read_row(scan_row);
+    board->unselect_rows();
+    if (++scan_row == MATRIX_ROWS) scan_row = 0;
+    matrix_pipeline_select(board);
+
+    return (scan_row == 0 ? MATRIX_PIPELINE_LAST_ROW : MATRIX_PIPELINE_ROW);
+}
+
+bool matrix_pipeline_busy(void)
+{
+    return scan_row != 0;
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MATRIX_PIPELINE_H
+#define MATRIX_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+
+/* time(us) for selected row to settle before it is read */
+#ifndef MATRIX_SETTLE_US
+#   define MATRIX_SETTLE_US     30
+#endif
+
+/* Row access of board matrix, none of them should wait.
+ * read_row() returns row selected with select_row(), keys on as 1. */
+typedef struct {
+    matrix_row_t (*read_row)(uint8_t row);
+    void (*select_row)(uint8_t row);
+    void (*unselect_rows)(void);
+} matrix_pipeline_t;
+
+/* result of matrix_pipeline_scan() */
+enum matrix_pipeline_result {
+    MATRIX_PIPELINE_SETTLING = 0,   /* row is not settled, nothing read */
+    MATRIX_PIPELINE_ROW,            /* a row is read */
+    MATRIX_PIPELINE_LAST_ROW,       /* last row is read, whole matrix is scanned */
+};
+
+/* (re)select row to read next, in matrix_init() and matrix_power_up() */
+void matrix_pipeline_select(const matrix_pipeline_t *board);
+/*
+ * Read row selected on last call into raw[] and select next one at once,
+ * the row settles while keyboard processes changes instead of busy-waiting.
+ * Call this from matrix_scan() and debounce when a row is read.
+ */
+uint8_t matrix_pipeline_scan(const matrix_pipeline_t *board, matrix_row_t raw[]);
+/* true while scan is in the middle of matrix, rest of rows are read in
+ * following calls without waiting for timer tick */
+bool matrix_pipeline_busy(void);
+
+#endif
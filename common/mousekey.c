@@ -125,6 +125,16 @@ void mousekey_task(void)
     mousekey_send();
 }
 
+uint16_t mousekey_deadline(void)
+{
+    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
+        return TIMER_NO_DEADLINE;
+
+    uint16_t period = (mousekey_repeat ? mk_interval : mk_delay*10);
+    uint16_t elapsed = timer_elapsed(last_timer);
+    return (elapsed >= period ? 0 : period - elapsed);
+}
+
 void mousekey_on(uint8_t code)
 {
     if      (code == KC_MS_UP)       mouse_report.y = move_unit() * -1;
@@ -61,6 +61,8 @@ uint8_t mk_wheel_time_to_max;
 
 
 void mousekey_task(void);
+/* wait(ms) till mousekey_task() has motion to send, TIMER_NO_DEADLINE when idle */
+uint16_t mousekey_deadline(void);
 void mousekey_on(uint8_t code);
 void mousekey_off(uint8_t code);
 void mousekey_clear(void);
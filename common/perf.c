@@ -0,0 +1,141 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timer.h"
+#include "print.h"
+#include "perf.h"
+
+
+uint32_t perf_counters[PERF_COUNTERS];
+uint16_t perf_maxes[PERF_MAXES];
+static uint16_t perf_hist[PERF_HIST_BUCKETS];
+static uint16_t task_start;
+static uint32_t reset_time = 0;
+
+
+/* time in TIMER_RAW counts, wraps around in 65536 counts */
+static inline uint16_t perf_clock(void)
+{
+#ifdef TCNT0
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = (uint16_t)timer_count;
+    uint8_t raw = TIMER_RAW;
+    /* compare match occured but its interrupt is not serviced yet */
+    if (TIFR0 & (1<<OCF0A)) {
+        raw = TIMER_RAW;
+        ms++;
+    }
+    SREG = sreg;
+    return ms * (TIMER_RAW_TOP + 1) + raw;
+#else
+    return (uint16_t)timer_count * (TIMER_RAW_TOP + 1);
+#endif
+}
+
+void perf_task_begin(void)
+{
+    task_start = perf_clock();
+}
+
+void perf_task_end(void)
+{
+    uint16_t d = perf_clock() - task_start;
+    PERF_MAX(PERF_MAX_TASK, d);
+
+    uint8_t b = 0;
+    d >>= PERF_HIST_SHIFT;
+    while (d && b < PERF_HIST_BUCKETS - 1) {
+        d >>= 1;
+        b++;
+    }
+    perf_hist[b]++;
+}
+
+/* TIMER_RAW counts in us, saturated for print_dec
+ * raw * 1000000 would overflow 32 bits at a few thousand counts. */
+static uint16_t raw_us(uint16_t raw)
+{
+#if (1000000 % TIMER_RAW_FREQ == 0)
+    uint32_t us = (uint32_t)raw * (1000000 / TIMER_RAW_FREQ);
+#else
+    uint32_t us = (uint32_t)raw * 1000 / (TIMER_RAW_FREQ / 1000);
+#endif
+    return (us > 0xFFFF ? 0xFFFF : us);
+}
+
+/* count per second */
+static uint16_t rate(uint32_t count, uint32_t ms)
+{
+    return (ms ? count * 1000 / ms : 0);
+}
+
+void perf_print(void)
+{
+    uint32_t counters[PERF_COUNTERS];
+    uint16_t maxes[PERF_MAXES];
+
+    /* counters of receive buffers are updated in interrupts */
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PERF_COUNTERS; i++) counters[i] = perf_counters[i];
+    for (uint8_t i = 0; i < PERF_MAXES; i++) maxes[i] = perf_maxes[i];
+    SREG = sreg;
+
+    uint32_t ms = timer_elapsed32(reset_time);
+
+    print("\n\n----- Perf -----\n");
+    print("time(ms): "); print_hex32(ms); print("\n");
+    print("task: "); print_hex32(counters[PERF_TASK]);
+    print(" ("); pdec(rate(counters[PERF_TASK], ms)); print("/s)\n");
+    print("scan: "); print_hex32(counters[PERF_SCAN]);
+    print(" ("); pdec(rate(counters[PERF_SCAN], ms)); print("/s)\n");
+    print("event: "); print_hex32(counters[PERF_EVENT]); print("\n");
+    print("tick: "); print_hex32(counters[PERF_TICK]); print("\n");
+    print("report keyboard: "); print_hex32(counters[PERF_REPORT_KEYBOARD]); print("\n");
+    print("report mouse: "); print_hex32(counters[PERF_REPORT_MOUSE]); print("\n");
+    print("report system: "); print_hex32(counters[PERF_REPORT_SYSTEM]); print("\n");
+    print("report consumer: "); print_hex32(counters[PERF_REPORT_CONSUMER]); print("\n");
+    print("report dropped: "); print_hex32(counters[PERF_REPORT_DROPPED]); print("\n");
+    print("recv: "); print_hex32(counters[PERF_RECV]); print("\n");
+    print("recv dropped: "); print_hex32(counters[PERF_RECV_DROPPED]); print("\n");
+    print("waiting_buffer overflow: "); print_hex32(counters[PERF_WAITING_OVERFLOW]); print("\n");
+    print("waiting_buffer max: "); pdec(maxes[PERF_MAX_WAITING]); print("\n");
+    print("recv buffer max: "); pdec(maxes[PERF_MAX_RECV]); print("\n");
+    print("task max(us): "); pdec(raw_us(maxes[PERF_MAX_TASK])); print("\n");
+    for (uint8_t b = 0; b < PERF_HIST_BUCKETS - 1; b++) {
+        print("task <"); pdec(raw_us(1UL<<(PERF_HIST_SHIFT + b)));
+        print("us: "); phex16(perf_hist[b]); print("\n");
+    }
+    print("task >="); pdec(raw_us(1UL<<(PERF_HIST_SHIFT + PERF_HIST_BUCKETS - 2)));
+    print("us: "); phex16(perf_hist[PERF_HIST_BUCKETS - 1]); print("\n");
+
+    perf_reset();
+}
+
+void perf_reset(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PERF_COUNTERS; i++) perf_counters[i] = 0;
+    for (uint8_t i = 0; i < PERF_MAXES; i++) perf_maxes[i] = 0;
+    SREG = sreg;
+    for (uint8_t b = 0; b < PERF_HIST_BUCKETS; b++) perf_hist[b] = 0;
+    reset_time = timer_read32();
+}
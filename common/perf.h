@@ -0,0 +1,94 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+
+/*
+ * Performance counters(PERF_ENABLE)
+ *
+ * Counters and high-water marks updated from hot paths, dumped and reset
+ * with command 'f'. Each update is an increment or compare of a global,
+ * and compiles to nothing without PERF_ENABLE.
+ */
+enum perf_counter_id {
+    PERF_TASK = 0,          /* keyboard_task() calls */
+    PERF_SCAN,              /* complete matrix scans */
+    PERF_EVENT,             /* key events to action_exec() */
+    PERF_TICK,              /* TICK to action_exec() */
+    PERF_REPORT_KEYBOARD,   /* reports to host driver */
+    PERF_REPORT_MOUSE,
+    PERF_REPORT_SYSTEM,
+    PERF_REPORT_CONSUMER,
+    PERF_REPORT_DROPPED,    /* reports protocol could not queue */
+    PERF_RECV,              /* data stored in protocol receive buffer */
+    PERF_RECV_DROPPED,      /* data lost for full receive buffer */
+    PERF_WAITING_OVERFLOW,  /* events which didn't fit in waiting_buffer */
+    PERF_COUNTERS
+};
+
+enum perf_max_id {
+    PERF_MAX_TASK = 0,      /* keyboard_task() duration in TIMER_RAW counts */
+    PERF_MAX_WAITING,       /* waiting_buffer entries */
+    PERF_MAX_RECV,          /* protocol receive buffer entries */
+    PERF_MAXES
+};
+
+/* histogram of keyboard_task() duration: bucket n counts durations
+ * shorter than 2^(PERF_HIST_SHIFT+n) TIMER_RAW counts, last one the rest. */
+#define PERF_HIST_BUCKETS   8
+#ifndef PERF_HIST_SHIFT
+#   define PERF_HIST_SHIFT  4
+#endif
+
+
+#ifdef PERF_ENABLE
+extern uint32_t perf_counters[PERF_COUNTERS];
+extern uint16_t perf_maxes[PERF_MAXES];
+
+#   define PERF_COUNT(id)       (perf_counters[id]++)
+#   define PERF_MAX(id, value)  do { \
+        uint16_t v_ = (value); \
+        if (v_ > perf_maxes[id]) perf_maxes[id] = v_; \
+    } while (0)
+#   define PERF_TASK_BEGIN()    perf_task_begin()
+#   define PERF_TASK_END()      perf_task_end()
+#else
+#   define PERF_COUNT(id)       ((void)0)
+#   define PERF_MAX(id, value)  ((void)0)
+#   define PERF_TASK_BEGIN()    ((void)0)
+#   define PERF_TASK_END()      ((void)0)
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void perf_task_begin(void);
+void perf_task_end(void);
+/* print counters and rates since last reset */
+void perf_print(void);
+void perf_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
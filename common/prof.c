@@ -0,0 +1,111 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "print.h"
+#include "util.h"
+#include "prof.h"
+
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+} prof_stat_t;
+
+static prof_stat_t stats[PROF_PROBES];
+/* counts of PROF_BEGIN and PROF_END without code between them */
+static uint16_t overhead = 0;
+
+
+void prof_init(void)
+{
+#ifdef TCNT1
+    // Timer1 normal mode, no interrupt
+    TCCR1A = 0x00;
+#   if PROF_PRESCALER == 1
+    TCCR1B = 0x01;
+#   elif PROF_PRESCALER == 8
+    TCCR1B = 0x02;
+#   elif PROF_PRESCALER == 64
+    TCCR1B = 0x03;
+#   else
+#       error "PROF_PRESCALER value is NOT valid."
+#   endif
+    TIMSK1 = 0x00;
+
+    uint16_t start = prof_clock();
+    overhead = prof_clock() - start;
+#endif
+    prof_reset();
+}
+
+void prof_record(uint8_t id, uint16_t count)
+{
+    prof_stat_t *s = &stats[id];
+    count = (count > overhead ? count - overhead : 0);
+
+    uint8_t sreg = SREG;
+    cli();
+    if (count < s->min) s->min = count;
+    if (count > s->max) s->max = count;
+    s->sum += count;
+    s->count++;
+    SREG = sreg;
+}
+
+void prof_print(void)
+{
+    static const char names[PROF_PROBES][16] PROGMEM = {
+        [PROF_KEYBOARD_TASK]        = "keyboard_task",
+        [PROF_MATRIX_SCAN]          = "matrix_scan",
+        [PROF_PROCESS_ACTION]       = "process_action",
+        [PROF_HOST_KEYBOARD_SEND]   = "keyboard_send",
+        [PROF_USB_TASK]             = "USB_USBTask",
+        [PROF_USB_HOST_TASK]        = "usb_host.Task",
+    };
+
+    print("\n\n----- Prof(cycles/" STR(PROF_PRESCALER) ") min/avg/max count -----\n");
+    for (uint8_t i = 0; i < PROF_PROBES; i++) {
+        prof_stat_t s;
+        uint8_t sreg = SREG;
+        cli();
+        s = stats[i];
+        SREG = sreg;
+        if (!s.count) continue;
+
+        print_P(names[i]); print(": ");
+        pdec(s.min); print("/");
+        pdec(s.sum / s.count); print("/");
+        pdec(s.max); print(" ");
+        print_hex32(s.count); print("\n");
+    }
+
+    prof_reset();
+}
+
+void prof_reset(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PROF_PROBES; i++) {
+        stats[i] = (prof_stat_t){ .min = UINT16_MAX };
+    }
+    SREG = sreg;
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+
+/*
+ * Cycle profiler(PROF_ENABLE)
+ *
+ * Timer1 runs free at F_CPU/PROF_PRESCALER and probes record min, avg and
+ * max counts of code between PROF_BEGIN(id) and PROF_END(id) in a block:
+ *
+ *     PROF_BEGIN(PROF_MATRIX_SCAN);
+ *     matrix_scan();
+ *     PROF_END(PROF_MATRIX_SCAN);
+ *
+ * Timer1 is 16 bit, a span longer than 65535 counts(4ms at 16MHz) wraps
+ * around; use PROF_PRESCALER 8 or more for such code. Time spent in
+ * interrupts is counted in span they interrupt. Timer1 is not available
+ * for others(e.g. LED PWM of phantom) with this option.
+ */
+enum prof_probe_id {
+    PROF_KEYBOARD_TASK = 0,
+    PROF_MATRIX_SCAN,
+    PROF_PROCESS_ACTION,
+    PROF_HOST_KEYBOARD_SEND,
+    PROF_USB_TASK,          /* USB_USBTask() of LUFA */
+    PROF_USB_HOST_TASK,     /* USB host task of converter/usb_usb */
+    PROF_PROBES
+};
+
+#ifndef PROF_PRESCALER
+#   define PROF_PRESCALER   1
+#endif
+
+
+#ifdef PROF_ENABLE
+#   define PROF_BEGIN(id)   uint16_t prof_start_##id = prof_clock()
+#   define PROF_END(id)     prof_record(id, prof_clock() - prof_start_##id)
+#else
+#   define PROF_BEGIN(id)   ((void)0)
+#   define PROF_END(id)     ((void)0)
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void prof_init(void);
+void prof_record(uint8_t id, uint16_t count);
+/* print and reset stats of probes */
+void prof_print(void);
+void prof_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#ifdef TCNT1
+#   define prof_clock()     TCNT1
+#else
+/* no Timer1(native build): spans are all zero */
+#   define prof_clock()     ((uint16_t)0)
+#endif
+
+#endif
@@ -78,8 +78,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   else
 #       define REPORT_KEYS KBD_REPORT_KEYS
 #   endif
+#   define REPORT_BYTE_KEYS KBD_REPORT_KEYS
+#elif defined(HOST_LUFA) && defined(NKRO_ENABLE)
+    /* NKRO bitmap of 120 keys, NKRO_EPSIZE(16) - mods(1) */
+#   define REPORT_KEYS 15
+#   define REPORT_BYTE_KEYS 6
 #else
 #   define REPORT_KEYS 6
+#   define REPORT_BYTE_KEYS 6
 #endif
 
 
@@ -0,0 +1,150 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include "matrix.h"
+#include "timer.h"
+#include "print.h"
+#include "sleep.h"
+
+
+/* length of timer period in TCNT0 counts */
+#define TIMER_RAW_PERIOD    ((uint16_t)TIMER_RAW_TOP + 1)
+
+/* raw time slept in idle since last sleep_print */
+static uint32_t idle_raw = 0;
+static uint16_t idle_count = 0;
+static uint16_t power_down_count = 0;
+static uint32_t print_time = 0;
+
+
+/* timer_count(low 16 bits) and TCNT0 combined. call with interrupt disabled. */
+static inline uint32_t now_raw(void)
+{
+    uint16_t ms = (uint16_t)timer_count;
+    uint8_t raw = TIMER_RAW;
+    /* compare match occured but its interrupt is not serviced yet */
+    if (TIFR0 & (1<<OCF0A)) {
+        raw = TIMER_RAW;
+        ms++;
+    }
+    return (uint32_t)ms * TIMER_RAW_PERIOD + raw;
+}
+
+void sleep_idle(void)
+{
+    uint32_t start, end;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    start = now_raw();
+    sleep_enable();
+    sei();          // sleep_cpu is executed before pending interrupt is serviced
+    sleep_cpu();
+    sleep_disable();
+    cli();
+    end = now_raw();
+    sei();
+
+    if (end < start) end += (uint32_t)0x10000 * TIMER_RAW_PERIOD;
+    idle_raw += end - start;
+    idle_count++;
+}
+
+void sleep_power_down(uint8_t wdto)
+{
+    matrix_power_down();
+
+    /* watchdog in interrupt mode */
+    cli();
+    wdt_reset();
+    MCUSR &= ~(1<<WDRF);
+    WDTCSR = (1<<WDCE) | (1<<WDE);
+    WDTCSR = (1<<WDIE) | ((wdto & 0x08) ? (1<<WDP3) : 0) | (wdto & 0x07);
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+#ifdef BODS
+    sleep_bod_disable();
+#endif
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    wdt_disable();
+
+    /* Timer0 is stopped in power down. Advance time by watchdog period so that
+     * debounce and timeouts see time passing; it overshoots on pin change wake. */
+    cli();
+    timer_count += (uint32_t)16<<wdto;
+    sei();
+    power_down_count++;
+
+    matrix_power_up();
+}
+
+bool sleep_wakeup_condition(void)
+{
+    while (!matrix_scan()) ;
+    for (uint8_t r = 0; r < matrix_rows(); r++) {
+        // debounced state needs more scans than a wake up gives
+        if (matrix_raw_row(r)) return true;
+    }
+    return false;
+}
+
+void sleep_print(void)
+{
+    uint32_t total = timer_elapsed32(print_time);
+    uint32_t idle = idle_raw / TIMER_RAW_PERIOD;
+    uint8_t pct = total ? (uint8_t)(idle * 100 / total) : 0;
+
+    print("sleep idle(%): "); pdec(pct); print("\n");
+    print("sleep idle count: "); pdec16(idle_count); print("\n");
+    print("sleep power down count: "); pdec16(power_down_count); print("\n");
+#if defined(SLEEP_ACTIVE_UA) && defined(SLEEP_IDLE_UA)
+    /* estimated from figures measured on the board */
+    uint32_t ua = ((uint32_t)SLEEP_ACTIVE_UA * (100 - pct) + (uint32_t)SLEEP_IDLE_UA * pct) / 100;
+    print("sleep average current(uA): "); pdec16(ua > 0xFFFF ? 0xFFFF : ua); print("\n");
+#endif
+
+    idle_raw = 0;
+    idle_count = 0;
+    power_down_count = 0;
+    print_time = timer_read32();
+}
+
+
+__attribute__ ((weak))
+void matrix_power_down(void) {}
+
+__attribute__ ((weak))
+void matrix_power_up(void) {}
+
+
+/* wake up from power down */
+ISR(WDT_vect)
+{
+}
+
+#ifdef PCINT0_vect
+EMPTY_INTERRUPT(PCINT0_vect);
+#endif
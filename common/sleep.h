@@ -0,0 +1,40 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/wdt.h>
+
+
+/*
+ * Sleep while keyboard has nothing to do(SLEEP_ENABLE)
+ *
+ * sleep_idle:          stop CPU until next interrupt(1ms timer, USB SOF, etc).
+ *                      call only when keyboard_deadline() is not zero.
+ * sleep_power_down:    stop oscillator until key press(pin change) or watchdog
+ *                      timeout(WDTO_*). for USB suspend.
+ */
+void sleep_idle(void);
+void sleep_power_down(uint8_t wdto);
+/* scan whole matrix and return true if any key is pressed(raw, not debounced) */
+bool sleep_wakeup_condition(void);
+/* print and reset idle ratio and counters */
+void sleep_print(void);
+
+#endif
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/interrupt.h>
 #include <stdint.h>
 #include "timer.h"
+#include "keyboard.h"
 
 
 // counter resolution 1ms
@@ -113,4 +114,15 @@ uint32_t timer_elapsed32(uint32_t last)
 ISR(TIMER0_COMPA_vect)
 {
     timer_count++;
+
+#ifdef MATRIX_SCAN_ISR
+    /* scan with interrupts enabled so as not to delay USB, skip if last one is still running */
+    static volatile bool scanning = false;
+    if (scanning) return;
+    scanning = true;
+    sei();
+    keyboard_scan();
+    cli();
+    scanning = false;
+#endif
 }
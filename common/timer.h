@@ -43,7 +43,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TIMER_DIFF_8(a, b)      TIMER_DIFF(a, b, UINT8_MAX)
 #define TIMER_DIFF_16(a, b)     TIMER_DIFF(a, b, UINT16_MAX)
 #define TIMER_DIFF_32(a, b)     TIMER_DIFF(a, b, UINT32_MAX)
-#define TIMER_DIFF_RAW(a, b)    TIMER_DIFF_8(a, b)
+/* TIMER_RAW counts 0 to TIMER_RAW_TOP in CTC mode, for waits shorter than 1ms */
+#define TIMER_DIFF_RAW(a, b)    TIMER_DIFF(a, b, TIMER_RAW_TOP)
+/* TIMER_DIFF_RAW larger than this has surely passed 'us' microseconds */
+#define TIMER_RAW_US(us)        ((us)/(1000000/TIMER_RAW_FREQ) + 1)
+
+/* wait(ms) till deadline when there is nothing to wait for */
+#define TIMER_NO_DEADLINE       UINT16_MAX
 
 
 #ifdef __cplusplus
@@ -15,6 +15,8 @@
 #include "timer.h"
 #include "debug.h"
 #include "keyboard.h"
+#include "prof.h"
+#include "boot.h"
 
 #include "leonardo_led.h"
 
@@ -47,10 +49,8 @@ static void HID_setup()
         debug("HID init: failed\n");
         LED_TX_OFF;
     }
-  
-    _delay_ms(200);
-      
-    kbd.SetReportParser(0, (HIDReportParser*)&kbd_parser);
+    // report parser is set in main loop after 200ms
+    boot_phase_begin(BOOT_MODULE);
 }
 
 int main(void)
@@ -69,37 +69,31 @@ int main(void)
     keyboard_init();
 
     LUFA_setup();
+    boot_phase_begin(BOOT_USB);
     sei();
 
-uint8_t ret;
-    // wait for startup of sendchar routine
-    while (USB_DeviceState != DEVICE_STATE_Configured) ;
-    if (debug_enable) {
-        _delay_ms(1000);
-    }
-
-    debug("init: start\n");
+    // USB host and device come up in parallel, see command 's' for boot time
     HID_setup();
-    
-    debug("init: done\n");
 
-uint16_t timer;
-// to see loop pulse with oscillo scope
-DDRF = (1<<7);
     for (;;) {
-PORTF ^= (1<<7);
+        if (boot_phase_running(BOOT_MODULE) && boot_phase_elapsed(BOOT_MODULE) >= 200) {
+            kbd.SetReportParser(0, (HIDReportParser*)&kbd_parser);
+            boot_phase_end(BOOT_MODULE);
+            debug("init: done\n");
+        }
+
         keyboard_task();
 
-timer = timer_read();
+        // see command 'f' with PROF_ENABLE for time of tasks
+        PROF_BEGIN(PROF_USB_HOST_TASK);
         usb_host.Task();
-timer = timer_elapsed(timer);
-if (timer > 100) {
-    debug("host.Task: "); debug_hex16(timer);  debug("\n");
-}
+        PROF_END(PROF_USB_HOST_TASK);
 
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
         // LUFA Task for control request
+        PROF_BEGIN(PROF_USB_TASK);
         USB_USBTask();
+        PROF_END(PROF_USB_TASK);
 #endif
     }
         
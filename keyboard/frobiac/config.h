@@ -51,13 +51,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 8
 #define MATRIX_COLS 6
+/* time(us) for selected row to settle, with MATRIX_SCAN_PIPELINE */
+#define MATRIX_SETTLE_US    20
 
 
 /* define if matrix has ghost */
 //#define MATRIX_HAS_GHOST
 
 /* Set 0 if need no debouncing */
-#define DEBOUNCE    5
+/* vertical counter takes power of two: 4ms with 2bit counters */
+#define DEBOUNCE    4
+#define DEBOUNCE_TYPE   DEBOUNCE_VCOUNTER
 
 /*
  * Boot magic keys
@@ -18,37 +18,33 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
-   Debounce code in matrix_scan() based on code from
+   Debounce is vertical counter of common/debounce.c(DEBOUNCE_VCOUNTER),
+   which is based on code from
         Peter Dannegger [danni/At/specs/d0t/de]
         described in German at bottom of page
             http://www.mikrocontroller.net/articles/Entprellung
         and discussed at
             http://www.mikrocontroller.net/topic/48465
-   Array extensions inspired by Pult.zip
-            http://www.mikrocontroller.net/topic/48465#1489399
    */
 
 #include <stdint.h>
 #include <stdbool.h>
 #include <avr/io.h>
 #include <util/delay.h>
-#include <util/atomic.h>
 #include "print.h"
 #include "debug.h"
 #include "util.h"
+#include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
+#include "matrix_pipeline.h"
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE	10
-#endif
-static uint8_t debouncing = DEBOUNCE;
+#define ALL_COLS_MASK ((1<<MATRIX_COLS)-1)  // 0x63 or all lower 6 bits
 
 /* matrix state(1:on, 0:off) */
-static uint16_t *matrix;
-static uint16_t *matrix_debouncing;
-static uint16_t matrix0[MATRIX_ROWS];
-static uint16_t matrix1[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_raw[MATRIX_ROWS];
 static bool is_modified;
 
 static uint16_t read_cols(void);
@@ -56,6 +52,11 @@ static void init_cols(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
 
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row);
+static const matrix_pipeline_t pipeline = { pipeline_read_row, select_row, unselect_rows };
+#endif
+
 
 inline uint8_t matrix_rows(void)
 {
@@ -74,60 +75,32 @@ void matrix_init(void)
     init_cols();
 
     // initialize matrix state: all keys off
-    matrix = matrix0;
-    matrix_debouncing = matrix1;
     for (uint8_t i=0; i < MATRIX_ROWS; i++) {
         matrix[i] = 0;
-        matrix_debouncing[i] = 0;
+        matrix_raw[i] = 0;
     }
+    debounce_init();
     is_modified = false;
-}
-
-
-/// debounce variables
-volatile uint8_t kb_state[MATRIX_ROWS];    // debounced and inverted key state: bit = 1: key pressed
-volatile uint8_t kb_press[MATRIX_ROWS];    // key press detect
-volatile uint8_t kb_release[MATRIX_ROWS];  // key release detect
-volatile uint8_t kb_rpt[MATRIX_ROWS];      // key long press and repeat
 
-static uint8_t ct0[MATRIX_ROWS], ct1[MATRIX_ROWS];
-static int32_t rpt[MATRIX_ROWS];
-
-#define ALL_COLS_MASK ((1<<MATRIX_COLS)-1)  // 0x63 or all lower 6 bits
-#define REPEAT_MASK    ALL_COLS_MASK // repeat: key0 = 0x3F = 63
-#define REPEAT_START   31            // 61 = 1000ms
-#define REPEAT_NEXT    15
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
+}
 
 
-uint8_t get_kb_release( uint8_t key_mask, uint8_t col)
+uint8_t matrix_scan(void)
 {
-    ATOMIC_BLOCK(ATOMIC_FORCEON) {
-        key_mask &= kb_release[col];                      // read key(s)
-        kb_release[col] ^= key_mask;                      // clear key(s)
+#ifdef MATRIX_SCAN_PIPELINE
+    uint8_t read = matrix_pipeline_scan(&pipeline, matrix_raw);
+    if (read == MATRIX_PIPELINE_SETTLING) {
+        is_modified = false;
+        return 0;
     }
-    return key_mask;
-}
 
-uint8_t get_kb_press( uint8_t key_mask, uint8_t col )
-{
-    ATOMIC_BLOCK(ATOMIC_FORCEON) {
-        key_mask &= kb_press[col];                      // read key(s)
-        kb_press[col] ^= key_mask;                      // clear key(s)
-    }
-    return key_mask;
-}
-uint8_t get_kb_rpt( uint8_t key_mask, uint8_t col )
-{
-    ATOMIC_BLOCK(ATOMIC_FORCEON) {
-        key_mask &= kb_rpt[col];                        // read key(s)
-        kb_rpt[col] ^= key_mask;                        // clear key(s)
-    }
-    return key_mask;
-}
+    is_modified = debounce(matrix_raw, matrix, timer_read());
 
-uint8_t matrix_scan(void)
-{
-    uint8_t i,data;
+    return (read == MATRIX_PIPELINE_LAST_ROW);
+#else
     for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
         select_row(row);
 
@@ -135,37 +108,13 @@ uint8_t matrix_scan(void)
         _delay_us(20);
 
         // Place data on all column pins for active row
-        // into a single 32 bit value.
-        data = read_cols();
-        /// @see top comment for source of debounce magic
-        // Needs to be adjusted for more than 8 columns
-        i = kb_state[row] ^ (~data);                    // key changed ?
-        ct0[row] = ~( ct0[row] & i );                   // reset or count ct0
-        ct1[row] = ct0[row] ^ (ct1[row] & i);           // reset or count ct1
-        i &= ct0[row] & ct1[row];                       // count until roll over ?
-        kb_state[row] ^= i;                             // then toggle debounced state
-
-        kb_press  [row] |=  kb_state[row] & i;          // 0->1: key press detect
-        kb_release[row] |= ~kb_state[row] & i;          // 1->0: key press detect
-        /*
-                if( (kb_state[row] & REPEAT_MASK) == 0 ) {      // check repeat function
-                    rpt[row] = idle_count + REPEAT_START;       // start delay
-                }
-                if(  rpt[row] <= idle_count ) {
-                    rpt[row] = idle_count + REPEAT_NEXT;        // repeat delay
-                    kb_rpt[row] |= kb_state[row] & REPEAT_MASK;
-                }
-        */
-        // Now evaluate results
-        uint8_t p,r,h;
-        p=get_kb_press  (ALL_COLS_MASK, row);
-        h=get_kb_rpt    (ALL_COLS_MASK, row);
-        r=get_kb_release(ALL_COLS_MASK, row);
-
-        matrix[row] = ((matrix[row]|(p|h)) & ~r);
+        matrix_raw[row] = ~read_cols() & ALL_COLS_MASK;
     }
 
+    is_modified = debounce(matrix_raw, matrix, timer_read());
+
     return 1;
+#endif
 }
 
 bool matrix_is_modified(void)
@@ -276,3 +225,10 @@ static void select_row(uint8_t row)
     DDRD |= (1<<(7-row));
 #endif
 }
+
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row)
+{
+    return ~read_cols() & ALL_COLS_MASK;
+}
+#endif
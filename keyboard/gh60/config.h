@@ -35,11 +35,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 5
 #define MATRIX_COLS 14
 
+/* matrix pins: X(row/col, port, bit, a), see common/matrix_pins.h */
+#define MATRIX_ROW_PINS(X, a) \
+    X(0, D, 0, a) X(1, D, 1, a) X(2, D, 2, a) X(3, D, 3, a) X(4, D, 5, a)
+#define MATRIX_COL_PINS(X, a) \
+    X( 0, F, 0, a) X( 1, F, 1, a) X( 2, E, 6, a) X( 3, C, 7, a) X( 4, C, 6, a) \
+    X( 5, B, 6, a) X( 6, D, 4, a) X( 7, B, 1, a) X( 8, B, 0, a) X( 9, B, 5, a) \
+    X(10, B, 4, a) X(11, D, 7, a) X(12, D, 6, a) X(13, B, 3, a)
+
 /* define if matrix has ghost */
 //#define MATRIX_HAS_GHOST
 
 /* Set 0 if need no debouncing */
-#define DEBOUNCE    5
+/* vertical counter takes power of two: 4ms with 2bit counters */
+#define DEBOUNCE    4
+#define DEBOUNCE_TYPE   DEBOUNCE_VCOUNTER
+
+/* cache resolved actions in RAM */
+#define ACTION_CACHE
 
 
 /* key combination for command */
@@ -180,6 +180,27 @@ action_t keymap_fn_to_action(uint8_t keycode)
     return action;
 }
 
+#ifdef TAPPING_TERM_PER_KEY
+/*
+ * Tapping term of Fn tap keys in 10ms unit, 0 for TAPPING_TERM
+ */
+static const uint8_t PROGMEM fn_tapping_terms[] = {
+    0,                                              // FN0
+    0,                                              // FN1
+    0,                                              // FN2
+    30,                                             // FN3  300ms for Semicolon
+};
+
+uint16_t keymap_tapping_term(uint8_t layer, key_t key)
+{
+    uint8_t keycode = keymap_key_to_keycode(layer, key);
+    if (IS_FN(keycode) && FN_INDEX(keycode) < sizeof(fn_tapping_terms)) {
+        return pgm_read_byte(&fn_tapping_terms[FN_INDEX(keycode)]) * 10;
+    }
+    return 0;
+}
+#endif
+
 /* convert key to action */
 action_t action_for_key(uint8_t layer, key_t key)
 {
@@ -25,19 +25,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "print.h"
 #include "debug.h"
 #include "util.h"
+#include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
+#include "matrix_pipeline.h"
+#include "matrix_pins.h"
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE	5
-#endif
-static uint8_t debouncing = DEBOUNCE;
-
 /* matrix state(1:on, 0:off) */
-static uint16_t *matrix;
-static uint16_t *matrix_debouncing;
-static uint16_t matrix0[MATRIX_ROWS];
-static uint16_t matrix1[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_raw[MATRIX_ROWS];
 static bool is_modified;
 
 static uint16_t read_cols(void);
@@ -45,6 +42,11 @@ static void init_cols(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
 
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row);
+static const matrix_pipeline_t pipeline = { pipeline_read_row, select_row, unselect_rows };
+#endif
+
 
 inline
 uint8_t matrix_rows(void)
@@ -65,45 +67,44 @@ void matrix_init(void)
     init_cols();
 
     // initialize matrix state: all keys off
-    matrix = matrix0;
-    matrix_debouncing = matrix1;
     for (uint8_t i=0; i < MATRIX_ROWS; i++) {
         matrix[i] = 0;
-        matrix_debouncing[i] = 0;
+        matrix_raw[i] = 0;
     }
+    debounce_init();
     is_modified = false;
+
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
 }
 
 uint8_t matrix_scan(void)
 {
+#ifdef MATRIX_SCAN_PIPELINE
+    uint8_t read = matrix_pipeline_scan(&pipeline, matrix_raw);
+    if (read == MATRIX_PIPELINE_SETTLING) {
+        is_modified = false;
+        return 0;
+    }
+
+    is_modified = debounce(matrix_raw, matrix, timer_read());
+
+    return (read == MATRIX_PIPELINE_LAST_ROW);
+#else
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
         //unselect_rows();
         select_row(i);
         _delay_us(30);  // without this wait read unstable value.
-        uint16_t cols = read_cols();
-        if (matrix_debouncing[i] != cols) {
-            matrix_debouncing[i] = cols;
-            if (debouncing) {
-                debug("bounce!: "); debug_hex(debouncing); debug("\n");
-            }
-            debouncing = DEBOUNCE;
-            is_modified = false;
-        }
+        matrix_raw[i] = read_cols();
         unselect_rows();
     }
     //unselect_rows();
 
-    if (debouncing) {
-        debouncing--;
-        _delay_ms(1);
-    } else {
-        uint16_t *tmp = matrix;
-        matrix = matrix_debouncing;
-        matrix_debouncing = tmp;
-        is_modified = true;
-    }
+    is_modified = debounce(matrix_raw, matrix, timer_read());
 
     return 1;
+#endif
 }
 
 bool matrix_is_modified(void)
@@ -148,77 +149,43 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-/* Column pin configuration
- * col: 0   1   2   3   4   5   6   7   8   9   10  11  12  13
- * pin: F0  F1  E6  C7  C6  B6  D4  B1  B0  B5  B4  D7  D6  B3
- */
+void matrix_power_down(void)
+{
+    matrix_pins_power_down();
+}
+
+void matrix_power_up(void)
+{
+    matrix_pins_power_up();
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
+}
+
+/* Column and row pins are declared in config.h */
 static void  init_cols(void)
 {
-    // Input with pull-up(DDR:0, PORT:1)
-    DDRF  &= ~(1<<0 | 1<<1);
-    PORTF |=  (1<<0 | 1<<1);
-    DDRE  &= ~(1<<6);
-    PORTE |=  (1<<6);
-    DDRD  &= ~(1<<7 | 1<<6 | 1<<4);
-    PORTD |=  (1<<7 | 1<<6 | 1<<4);
-    DDRC  &= ~(1<<7 | 1<<6);
-    PORTC |=  (1<<7 | 1<<6);
-    DDRB  &= ~(1<<6 | 1<< 5 | 1<<4 | 1<<3 | 1<<1 | 1<<0);
-    PORTB |=  (1<<6 | 1<< 5 | 1<<4 | 1<<3 | 1<<1 | 1<<0);
+    matrix_pins_init_cols();
 }
 
 static uint16_t read_cols(void)
 {
-    return (PINF&(1<<0) ? 0 : (1<<0)) |
-           (PINF&(1<<1) ? 0 : (1<<1)) |
-           (PINE&(1<<6) ? 0 : (1<<2)) |
-           (PINC&(1<<7) ? 0 : (1<<3)) |
-           (PINC&(1<<6) ? 0 : (1<<4)) |
-           (PINB&(1<<6) ? 0 : (1<<5)) |
-           (PIND&(1<<4) ? 0 : (1<<6)) |
-           (PINB&(1<<1) ? 0 : (1<<7)) |
-           (PINB&(1<<0) ? 0 : (1<<8)) |
-           (PINB&(1<<5) ? 0 : (1<<9)) |
-           (PINB&(1<<4) ? 0 : (1<<10)) |
-           (PIND&(1<<7) ? 0 : (1<<11)) |
-           (PIND&(1<<6) ? 0 : (1<<12)) |
-           (PINB&(1<<3) ? 0 : (1<<13));
-}
-
-/* Row pin configuration
- * row: 0   1   2   3   4
- * pin: D0  D1  D2  D3  D5
- */
+    return matrix_pins_read_cols();
+}
+
 static void unselect_rows(void)
 {
-    // Hi-Z(DDR:0, PORT:0) to unselect
-    DDRD  &= ~0b00101111;
-    PORTD &= ~0b00101111;
+    matrix_pins_unselect_rows();
 }
 
 static void select_row(uint8_t row)
 {
-    // Output low(DDR:1, PORT:0) to select
-    switch (row) {
-        case 0:
-            DDRD  |= (1<<0);
-            PORTD &= ~(1<<0);
-            break;
-        case 1:
-            DDRD  |= (1<<1);
-            PORTD &= ~(1<<1);
-            break;
-        case 2:
-            DDRD  |= (1<<2);
-            PORTD &= ~(1<<2);
-            break;
-        case 3:
-            DDRD  |= (1<<3);
-            PORTD &= ~(1<<3);
-            break;
-        case 4:
-            DDRD  |= (1<<5);
-            PORTD &= ~(1<<5);
-            break;
-    }
+    matrix_pins_select_row(row);
+}
+
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row)
+{
+    return read_cols();
 }
+#endif
@@ -22,7 +22,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "print.h"
 #include "debug.h"
 #include "util.h"
+#include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
+#include "matrix_pipeline.h"
 
 
 /*
@@ -41,23 +44,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE	0
-#endif
-static uint8_t debouncing = DEBOUNCE;
-
 // matrix state buffer(1:on, 0:off)
-#if (MATRIX_COLS <= 8)
-static uint8_t *matrix;
-static uint8_t *matrix_prev;
-static uint8_t _matrix0[MATRIX_ROWS];
-static uint8_t _matrix1[MATRIX_ROWS];
-#else
-static uint16_t *matrix;
-static uint16_t *matrix_prev;
-static uint16_t _matrix0[MATRIX_ROWS];
-static uint16_t _matrix1[MATRIX_ROWS];
-#endif
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_raw[MATRIX_ROWS];
+static bool is_modified;
 
 #ifdef MATRIX_HAS_GHOST
 static bool matrix_has_ghost_in_row(uint8_t row);
@@ -66,6 +56,11 @@ static uint8_t read_col(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
 
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row);
+static const matrix_pipeline_t pipeline = { pipeline_read_row, select_row, unselect_rows };
+#endif
+
 
 inline
 uint8_t matrix_rows(void)
@@ -100,51 +95,46 @@ void matrix_init(void)
     PORTD = 0xFF;
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_prev = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix_raw[i] = 0x00;
+    debounce_init();
+    is_modified = false;
+
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
 }
 
 uint8_t matrix_scan(void)
 {
-    if (!debouncing) {
-        uint8_t *tmp = matrix_prev;
-        matrix_prev = matrix;
-        matrix = tmp;
+#ifdef MATRIX_SCAN_PIPELINE
+    uint8_t read = matrix_pipeline_scan(&pipeline, matrix_raw);
+    if (read == MATRIX_PIPELINE_SETTLING) {
+        is_modified = false;
+        return 0;
     }
 
+    is_modified = debounce(matrix_raw, matrix, timer_read());
+
+    return (read == MATRIX_PIPELINE_LAST_ROW);
+#else
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
         unselect_rows();
         select_row(i);
         _delay_us(30);  // without this wait read unstable value.
-        if (matrix[i] != (uint8_t)~read_col()) {
-            matrix[i] = (uint8_t)~read_col();
-            if (debouncing) {
-                debug("bounce!: "); debug_hex(debouncing); print("\n");
-            }
-            _delay_ms(1);   // TODO: work around. HAHAHAHAHAAHA
-            debouncing = DEBOUNCE;
-        }
+        matrix_raw[i] = (uint8_t)~read_col();
     }
     unselect_rows();
 
-    if (debouncing) {
-        debouncing--;
-    }
+    is_modified = debounce(matrix_raw, matrix, timer_read());
 
     return 1;
+#endif
 }
 
 bool matrix_is_modified(void)
 {
-    if (debouncing) return false;
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix[i] != matrix_prev[i]) {
-            return true;
-        }
-    }
-    return false;
+    return is_modified;
 }
 
 inline
@@ -166,11 +156,7 @@ bool matrix_is_on(uint8_t row, uint8_t col)
 }
 
 inline
-#if (MATRIX_COLS <= 8)
-uint8_t matrix_get_row(uint8_t row)
-#else
-uint16_t matrix_get_row(uint8_t row)
-#endif
+matrix_row_t matrix_get_row(uint8_t row)
 {
     return matrix[row];
 }
@@ -268,3 +254,10 @@ static void select_row(uint8_t row)
             break;
     }
 }
+
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row)
+{
+    return (uint8_t)~read_col();
+}
+#endif
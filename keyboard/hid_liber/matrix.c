@@ -15,19 +15,14 @@
 #include "print.h"
 #include "debug.h"
 #include "util.h"
+#include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE 0
-#endif
-static uint8_t debouncing = DEBOUNCE;
-
-// bit array of key state(1:on, 0:off)
-static matrix_row_t *matrix;
-static matrix_row_t *matrix_debounced;
-static matrix_row_t _matrix0[MATRIX_ROWS];
-static matrix_row_t _matrix1[MATRIX_ROWS];
+// bit array of key state(1:on, 0:off), raw and debounced
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_debounced[MATRIX_ROWS];
 
 
 #define _DDRA (uint8_t *const)&DDRA
@@ -148,20 +143,13 @@ void matrix_init(void)
     setup_leds();
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_debounced = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix_debounced[i] = 0x00;
+    debounce_init();
 }
 
 uint8_t matrix_scan(void)
 {
-    if (!debouncing) {
-        uint8_t *tmp = matrix_debounced;
-        matrix_debounced = matrix;
-        matrix = tmp;
-    }
-
     for (uint8_t col = 0; col < MATRIX_COLS; col++) {  // 0-7
         pull_column(col);   // output hi on theline
         _delay_us(5);       // without this wait it won't read stable value.
@@ -170,19 +158,12 @@ uint8_t matrix_scan(void)
             bool curr_bit = *row_pin[row] & row_bit[row];
             if (prev_bit != curr_bit) {
                 matrix[row] ^= (1<<col);
-                if (debouncing) {
-                    debug("bounce!: "); debug_hex(debouncing); print("\n");
-                }
-                _delay_ms(1); // improved affect on bouncing
-                debouncing = DEBOUNCE;
             }
         }
         release_column(col);
     }
 
-    if (debouncing) {
-        debouncing--;
-    }
+    debounce(matrix, matrix_debounced, timer_read());
 
     return 1;
 }
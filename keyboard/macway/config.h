@@ -37,6 +37,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* matrix size */
 #define MATRIX_ROWS 9
 #define MATRIX_COLS 8
+
+/* matrix pins: X(row/col, port, bit, a), see common/matrix_pins.h */
+#define MATRIX_ROW_PINS(X, a) \
+    X(0, D, 0, a) X(1, D, 5, a) X(2, D, 7, a) X(3, F, 6, a) X(4, D, 6, a) \
+    X(5, D, 1, a) X(6, D, 2, a) X(7, C, 6, a) X(8, F, 7, a)
+#define MATRIX_COL_PINS(X, a) \
+    X(0, B, 0, a) X(1, B, 1, a) X(2, B, 2, a) X(3, B, 3, a) \
+    X(4, B, 4, a) X(5, B, 5, a) X(6, B, 6, a) X(7, B, 7, a)
 /* define if matrix has ghost */
 #define MATRIX_HAS_GHOST
 /* Set 0 if need no debouncing */
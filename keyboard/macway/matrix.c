@@ -25,7 +25,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "print.h"
 #include "debug.h"
 #include "util.h"
+#include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
+#include "matrix_pipeline.h"
+#include "matrix_pins.h"
 
 
 #if (MATRIX_COLS > 16)
@@ -36,23 +40,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE	0
-#endif
-static uint8_t debouncing = DEBOUNCE;
-
 // matrix state buffer(1:on, 0:off)
-#if (MATRIX_COLS <= 8)
-static uint8_t *matrix;
-static uint8_t *matrix_prev;
-static uint8_t _matrix0[MATRIX_ROWS];
-static uint8_t _matrix1[MATRIX_ROWS];
-#else
-static uint16_t *matrix;
-static uint16_t *matrix_prev;
-static uint16_t _matrix0[MATRIX_ROWS];
-static uint16_t _matrix1[MATRIX_ROWS];
-#endif
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_raw[MATRIX_ROWS];
+static bool is_modified;
 
 #ifdef MATRIX_HAS_GHOST
 static bool matrix_has_ghost_in_row(uint8_t row);
@@ -61,6 +52,11 @@ static uint8_t read_col(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
 
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row);
+static const matrix_pipeline_t pipeline = { pipeline_read_row, select_row, unselect_rows };
+#endif
+
 
 inline
 uint8_t matrix_rows(void)
@@ -78,55 +74,49 @@ void matrix_init(void)
 {
     // initialize row and col
     unselect_rows();
-    // Input with pull-up(DDR:0, PORT:1)
-    DDRB = 0x00;
-    PORTB = 0xFF;
+    matrix_pins_init_cols();
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_prev = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix_raw[i] = 0x00;
+    debounce_init();
+    is_modified = false;
+
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
 }
 
 uint8_t matrix_scan(void)
 {
-    if (!debouncing) {
-        uint8_t *tmp = matrix_prev;
-        matrix_prev = matrix;
-        matrix = tmp;
+#ifdef MATRIX_SCAN_PIPELINE
+    uint8_t read = matrix_pipeline_scan(&pipeline, matrix_raw);
+    if (read == MATRIX_PIPELINE_SETTLING) {
+        is_modified = false;
+        return 0;
     }
 
+    is_modified = debounce(matrix_raw, matrix, timer_read());
+
+    return (read == MATRIX_PIPELINE_LAST_ROW);
+#else
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
         unselect_rows();
         select_row(i);
         _delay_us(30);  // without this wait read unstable value.
-        if (matrix[i] != (uint8_t)~read_col()) {
-            matrix[i] = (uint8_t)~read_col();
-            if (debouncing) {
-                debug("bounce!: "); debug_hex(debouncing); print("\n");
-            }
-            debouncing = DEBOUNCE;
-        }
+        matrix_raw[i] = read_col();
     }
     unselect_rows();
 
-    if (debouncing) {
-        debouncing--;
-    }
+    is_modified = debounce(matrix_raw, matrix, timer_read());
 
     return 1;
+#endif
 }
 
 bool matrix_is_modified(void)
 {
-    if (debouncing) return false;
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix[i] != matrix_prev[i]) {
-            return true;
-        }
-    }
-    return false;
+    return is_modified;
 }
 
 inline
@@ -148,11 +138,7 @@ bool matrix_is_on(uint8_t row, uint8_t col)
 }
 
 inline
-#if (MATRIX_COLS <= 8)
-uint8_t matrix_get_row(uint8_t row)
-#else
-uint16_t matrix_get_row(uint8_t row)
-#endif
+matrix_row_t matrix_get_row(uint8_t row)
 {
     return matrix[row];
 }
@@ -189,6 +175,19 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
+void matrix_power_down(void)
+{
+    matrix_pins_power_down();
+}
+
+void matrix_power_up(void)
+{
+    matrix_pins_power_up();
+#ifdef MATRIX_SCAN_PIPELINE
+    matrix_pipeline_select(&pipeline);
+#endif
+}
+
 #ifdef MATRIX_HAS_GHOST
 inline
 static bool matrix_has_ghost_in_row(uint8_t row)
@@ -206,66 +205,28 @@ static bool matrix_has_ghost_in_row(uint8_t row)
 }
 #endif
 
+/* Column and row pins are declared in config.h */
 inline
 static uint8_t read_col(void)
 {
-    return PINB;
+    return matrix_pins_read_cols();
 }
 
 inline
 static void unselect_rows(void)
 {
-    // Hi-Z(DDR:0, PORT:0) to unselect
-    DDRC  &= ~0b01000000; // PC: 6
-    PORTC &= ~0b01000000;
-    DDRD  &= ~0b11100111; // PD: 7,6,5,2,1,0
-    PORTD &= ~0b11100111;
-    DDRF  &= ~0b11000000; // PF: 7,6
-    PORTF &= ~0b11000000;
+    matrix_pins_unselect_rows();
 }
 
 inline
 static void select_row(uint8_t row)
 {
-    // Output low(DDR:1, PORT:0) to select
-    // row: 0    1    2    3    4    5    6    7    8
-    // pin: PD0, PD5, PD7, PF6, PD6, PD1, PD2, PC6, PF7
-    switch (row) {
-        case 0:
-            DDRD  |= (1<<0);
-            PORTD &= ~(1<<0);
-            break;
-        case 1:
-            DDRD  |= (1<<5);
-            PORTD &= ~(1<<5);
-            break;
-        case 2:
-            DDRD  |= (1<<7);
-            PORTD &= ~(1<<7);
-            break;
-        case 3:
-            DDRF  |= (1<<6);
-            PORTF &= ~(1<<6);
-            break;
-        case 4:
-            DDRD  |= (1<<6);
-            PORTD &= ~(1<<6);
-            break;
-        case 5:
-            DDRD  |= (1<<1);
-            PORTD &= ~(1<<1);
-            break;
-        case 6:
-            DDRD  |= (1<<2);
-            PORTD &= ~(1<<2);
-            break;
-        case 7:
-            DDRC  |= (1<<6);
-            PORTC &= ~(1<<6);
-            break;
-        case 8:
-            DDRF  |= (1<<7);
-            PORTF &= ~(1<<7);
-            break;
-    }
+    matrix_pins_select_row(row);
 }
+
+#ifdef MATRIX_SCAN_PIPELINE
+static matrix_row_t pipeline_read_row(uint8_t row)
+{
+    return read_col();
+}
+#endif
@@ -36,6 +36,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host_driver.h"
 #include "iwrap.h"
 #include "print.h"
+#include "timer.h"
 
 
 /* iWRAP MUX mode utils. 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf) */
@@ -136,15 +137,40 @@ ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
 /*------------------------------------------------------------------*
  * iWRAP communication
  *------------------------------------------------------------------*/
+/* steps of init run by iwrap_init_task() */
+#define INIT_RESET  0
+#define INIT_MUX    1
+#define INIT_DONE   2
+static uint8_t init_step = INIT_DONE;
+static uint16_t init_timer = 0;
+
 void iwrap_init(void)
 {
     // reset iWRAP if in already MUX mode after AVR software-reset
     iwrap_send("RESET");
     iwrap_mux_send("RESET");
-    _delay_ms(3000);
-    iwrap_send("\r\nSET CONTROL MUX 1\r\n");
-    _delay_ms(500);
-    iwrap_check_connection();
+    init_step = INIT_RESET;
+    init_timer = timer_read();
+}
+
+/* run from main loop after iwrap_init(). returns true when iWRAP is ready. */
+bool iwrap_init_task(void)
+{
+    switch (init_step) {
+        case INIT_RESET:
+            if (timer_elapsed(init_timer) < 3000) return false;
+            iwrap_send("\r\nSET CONTROL MUX 1\r\n");
+            init_step = INIT_MUX;
+            init_timer = timer_read();
+            return false;
+        case INIT_MUX:
+            if (timer_elapsed(init_timer) < 500) return false;
+            iwrap_check_connection();
+            init_step = INIT_DONE;
+            return true;
+        default:
+            return true;
+    }
 }
 
 void iwrap_mux_send(const char *s)
@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 host_driver_t *iwrap_driver(void);
 
 void iwrap_init(void);
+bool iwrap_init_task(void);
 void iwrap_send(const char *s);
 void iwrap_mux_send(const char *s);
 void iwrap_buf_send(void);
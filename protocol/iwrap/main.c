@@ -17,9 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
-//#include <avr/wdt.h>
-#include "wd.h" // in order to use watchdog in interrupt mode
-#include <avr/sleep.h>
+#include <avr/wdt.h>
 #include <util/delay.h>
 #include <avr/power.h>
 #include "keyboard.h"
@@ -36,9 +34,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "keycode.h"
 #include "command.h"
+#include "boot.h"
+#include "sleep.h"
+
+
+/* watchdog sleep and its WDT_vect are in common/sleep.c */
+#ifndef SLEEP_ENABLE
+#   error "iWRAP needs SLEEP_ENABLE for sleep_power_down()"
+#endif
 
 
-static void sleep(uint8_t term);
 static bool console(void);
 static uint8_t console_command(uint8_t c);
 static uint8_t key2asc(uint8_t key);
@@ -112,6 +117,7 @@ void change_driver(host_driver_t *driver)
     host_swap_keyboard_report();
     host_clear_keyboard_report();
     host_send_keyboard_report();
+    host_flush_keyboard_report();
     _delay_ms(1000);
     host_set_driver(driver);
 }
@@ -125,7 +131,7 @@ int main(void)
 {
     MCUSR = 0;
     clock_prescale_set(clock_div_1);
-    WD_SET(WD_OFF);
+    wdt_disable();
 
     // power saving: the result is worse than nothing... why?
     //pullup_pins();
@@ -151,14 +157,20 @@ int main(void)
     PCMSK1 = 0b00100000;
     PCICR  = 0b00000010;
 
-    host_set_driver(iwrap_driver());
-
+    // driver is set when iWRAP gets ready, keyboard runs in the meantime
     print("iwrap_init()\n");
     iwrap_init();
-    iwrap_call();
+    boot_phase_begin(BOOT_MODULE);
 
     last_timer = timer_read();
     while (true) {
+        if (boot_phase_running(BOOT_MODULE) && iwrap_init_task()) {
+            boot_phase_end(BOOT_MODULE);
+            // unless switched to USB in the meantime
+            if (!host_get_driver()) host_set_driver(iwrap_driver());
+            iwrap_call();
+        }
+
 #ifdef HOST_VUSB
         if (host_get_driver() == vusb_driver())
             usbPoll();
@@ -180,32 +192,12 @@ int main(void)
             if (sleeping && !insomniac) {
                 _delay_ms(1);   // wait for UART to send
                 iwrap_sleep();
-                sleep(WDTO_60MS);
+                sleep_power_down(WDTO_60MS);
             }
         }
     }
 }
 
-static void sleep(uint8_t term)
-{
-    WD_SET(WD_IRQ, term);
-
-    cli();
-    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-    sleep_enable();
-    sleep_bod_disable();
-    sei();
-    sleep_cpu();
-    sleep_disable();
-
-    WD_SET(WD_OFF);
-}
-
-ISR(WDT_vect)
-{
-    // wake up
-}
-
 static bool console(void)
 {
         // Send to Bluetoot module WT12
@@ -268,7 +260,9 @@ static uint8_t console_command(uint8_t c)
             return 0;
         case 'r':
             print("reset\n");
-            WD_AVR_RESET();
+            cli();
+            wdt_enable(WDTO_15MS);
+            while (1) ;
             return 1;
         case 'i':
             insomniac = !insomniac;
@@ -42,16 +42,29 @@
 #include "keyboard.h"
 #include "sendchar.h"
 #include "debug.h"
+#include "perf.h"
+#include "prof.h"
+#include "boot.h"
 
 #include "descriptor.h"
 #include "lufa.h"
+#include <util/atomic.h>
+#ifdef SLEEP_ENABLE
+#include "sleep.h"
+#endif
 
 static uint8_t idle_duration = 0;
 static uint8_t protocol_report = 1;
+#ifdef NKRO_ENABLE
+/* set by SET_PROTOCOL request, handled in main loop */
+static volatile bool protocol_changed = false;
+#endif
 static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
 
+static void Report_Task(void);
+
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
@@ -130,6 +143,103 @@ static void Console_Task(void)
 #endif
 
 
+/*******************************************************************************
+ * Report send buffer
+ *
+ * Host driver queues reports here and they are written to endpoint when it
+ * gets ready, from main loop and Start of Frame event. keyboard_task() never
+ * waits for host polling.
+ * Rings are single producer(main loop) and single consumer(Report_Task with
+ * interrupt disabled).
+ ******************************************************************************/
+#ifndef KBUF_SIZE
+#   define KBUF_SIZE 8
+#endif
+#ifndef MBUF_SIZE
+#   define MBUF_SIZE 4
+#endif
+#ifndef EBUF_SIZE
+#   define EBUF_SIZE 4
+#endif
+
+static report_keyboard_t kbuf[KBUF_SIZE];
+static uint8_t kbuf_head = 0;
+static uint8_t kbuf_tail = 0;
+#ifdef NKRO_ENABLE
+/* report format of each entry, keyboard_nkro can change while queued */
+static bool kbuf_nkro[KBUF_SIZE];
+#endif
+
+#ifdef MOUSE_ENABLE
+static report_mouse_t mbuf[MBUF_SIZE];
+static uint8_t mbuf_head = 0;
+static uint8_t mbuf_tail = 0;
+#endif
+
+#ifdef EXTRAKEY_ENABLE
+static report_extra_t ebuf[EBUF_SIZE];
+static uint8_t ebuf_head = 0;
+static uint8_t ebuf_tail = 0;
+#endif
+
+/* reports lost or overwritten by overflow, or dropped while not configured */
+uint16_t lufa_keyboard_dropped = 0;
+uint16_t lufa_mouse_dropped = 0;
+uint16_t lufa_extra_dropped = 0;
+
+static void Report_Task(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+
+#ifdef NKRO_ENABLE
+    if (kbuf_head != kbuf_tail && kbuf_nkro[kbuf_tail]) {
+        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
+        if (Endpoint_IsReadWriteAllowed()) {
+            /* mods and key bitmap without reserved byte */
+            Endpoint_Write_8(kbuf[kbuf_tail].mods);
+            Endpoint_Write_Stream_LE(kbuf[kbuf_tail].keys, NKRO_SIZE, NULL);
+            Endpoint_ClearIN();
+            keyboard_report_sent = kbuf[kbuf_tail];
+            kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
+        }
+    } else
+#endif
+    {
+        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+        if (kbuf_head != kbuf_tail && Endpoint_IsReadWriteAllowed()) {
+            /* boot keyboard report: mods, reserved and 6 keys */
+            Endpoint_Write_Stream_LE(&kbuf[kbuf_tail], KEYBOARD_EPSIZE, NULL);
+            Endpoint_ClearIN();
+            keyboard_report_sent = kbuf[kbuf_tail];
+            kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
+        }
+    }
+
+#ifdef MOUSE_ENABLE
+    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
+    if (mbuf_head != mbuf_tail && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_Stream_LE(&mbuf[mbuf_tail], sizeof(report_mouse_t), NULL);
+        Endpoint_ClearIN();
+        mbuf_tail = (mbuf_tail + 1) % MBUF_SIZE;
+    }
+#endif
+
+#ifdef EXTRAKEY_ENABLE
+    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
+    if (ebuf_head != ebuf_tail && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_Stream_LE(&ebuf[ebuf_tail], sizeof(report_extra_t), NULL);
+        Endpoint_ClearIN();
+        ebuf_tail = (ebuf_tail + 1) % EBUF_SIZE;
+    }
+#endif
+
+    Endpoint_SelectEndpoint(ep);
+}
+
+
 /*******************************************************************************
  * USB Events
  ******************************************************************************/
@@ -145,6 +255,7 @@ void EVENT_USB_Device_Disconnect(void)
 
 void EVENT_USB_Device_StartOfFrame(void)
 {
+    Report_Task();
     Console_Task();
 }
 
@@ -164,6 +275,8 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 {
     bool ConfigSuccess = true;
 
+    boot_phase_end(BOOT_USB);
+
     /* Setup Keyboard HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
@@ -187,6 +300,12 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(CONSOLE_OUT_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_OUT,
                                      CONSOLE_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
+
+#ifdef NKRO_ENABLE
+    /* Setup NKRO HID Report Endpoints */
+    ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+                                     NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
+#endif
 }
 
 /*
@@ -223,7 +342,7 @@ void EVENT_USB_Device_ControlRequest(void)
                 case KEYBOARD_INTERFACE:
                     // TODO: test/check
                     ReportData = (uint8_t*)&keyboard_report_sent;
-                    ReportSize = sizeof(keyboard_report_sent);
+                    ReportSize = KEYBOARD_EPSIZE;
                     break;
                 }
 
@@ -240,6 +359,9 @@ void EVENT_USB_Device_ControlRequest(void)
                 // Interface
                 switch (USB_ControlRequest.wIndex) {
                 case KEYBOARD_INTERFACE:
+#ifdef NKRO_ENABLE
+                case NKRO_INTERFACE:
+#endif
                     Endpoint_ClearSETUP();
 
                     while (!(Endpoint_IsOUTReceived())) {
@@ -275,6 +397,9 @@ void EVENT_USB_Device_ControlRequest(void)
                 Endpoint_ClearStatusStage();
 
                 protocol_report = ((USB_ControlRequest.wValue & 0xFF) != 0x00);
+#ifdef NKRO_ENABLE
+                protocol_changed = true;
+#endif
             }
 
             break;
@@ -312,69 +437,92 @@ static uint8_t keyboard_leds(void)
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    uint8_t timeout = 0;
-
-    // TODO: handle NKRO report
-    /* Select the Keyboard Report Endpoint */
-    Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
-
-    /* Check if Keyboard Endpoint Ready for Read/Write */
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-
-    /* Write Keyboard Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_keyboard_t), NULL);
-
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+        lufa_keyboard_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        return;
+    }
 
-    keyboard_report_sent = *report;
+    uint8_t next = (kbuf_head + 1) % KBUF_SIZE;
+    if (next != kbuf_tail) {
+        kbuf[kbuf_head] = *report;
+#ifdef NKRO_ENABLE
+        kbuf_nkro[kbuf_head] = keyboard_nkro;
+#endif
+        kbuf_head = next;
+    } else {
+        // overwrite newest so that host gets latest state at least
+        uint8_t last = (kbuf_head + KBUF_SIZE - 1) % KBUF_SIZE;
+        kbuf[last] = *report;
+#ifdef NKRO_ENABLE
+        kbuf_nkro[last] = keyboard_nkro;
+#endif
+        lufa_keyboard_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        debug("kbuf: full\n");
+    }
 }
 
 static void send_mouse(report_mouse_t *report)
 {
 #ifdef MOUSE_ENABLE
-    uint8_t timeout = 0;
-
-    /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
-
-    /* Check if Mouse Endpoint Ready for Read/Write */
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-
-    /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+        lufa_mouse_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        return;
+    }
 
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+    uint8_t next = (mbuf_head + 1) % MBUF_SIZE;
+    if (next != mbuf_tail) {
+        mbuf[mbuf_head] = *report;
+        mbuf_head = next;
+    } else {
+        lufa_mouse_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        debug("mbuf: full\n");
+    }
 #endif
 }
 
-static void send_system(uint16_t data)
+#ifdef EXTRAKEY_ENABLE
+static void send_extra(uint8_t report_id, uint16_t data)
 {
-    uint8_t timeout = 0;
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+        lufa_extra_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        return;
+    }
 
     report_extra_t r = {
-        .report_id = REPORT_ID_SYSTEM,
+        .report_id = report_id,
         .usage = data
     };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+    uint8_t next = (ebuf_head + 1) % EBUF_SIZE;
+    if (next != ebuf_tail) {
+        ebuf[ebuf_head] = r;
+        ebuf_head = next;
+    } else {
+        // overwrite newest so that host gets latest state at least
+        ebuf[(ebuf_head + EBUF_SIZE - 1) % EBUF_SIZE] = r;
+        lufa_extra_dropped++;
+        PERF_COUNT(PERF_REPORT_DROPPED);
+        debug("ebuf: full\n");
+    }
 }
+#endif
 
-static void send_consumer(uint16_t data)
+static void send_system(uint16_t data)
 {
-    uint8_t timeout = 0;
+#ifdef EXTRAKEY_ENABLE
+    send_extra(REPORT_ID_SYSTEM, data);
+#endif
+}
 
-    report_extra_t r = {
-        .report_id = REPORT_ID_CONSUMER,
-        .usage = data
-    };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-    while (--timeout && !Endpoint_IsReadWriteAllowed()) ;
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+static void send_consumer(uint16_t data)
+{
+#ifdef EXTRAKEY_ENABLE
+    send_extra(REPORT_ID_CONSUMER, data);
+#endif
 }
 
 
@@ -470,6 +618,7 @@ int main(void)  __attribute__ ((weak));
 int main(void)
 {
     SetupHardware();
+    boot_phase_begin(BOOT_USB);
     keyboard_init();
     host_set_driver(&lufa_driver);
     sei();
@@ -477,10 +626,43 @@ int main(void)
     // TODO: can't print here
     debug("LUFA init\n");
     while (1) {
+#ifdef SLEEP_ENABLE
+        while (USB_DeviceState == DEVICE_STATE_Suspended) {
+            sleep_power_down(WDTO_15MS);
+            if (USB_Device_RemoteWakeupEnabled && sleep_wakeup_condition()) {
+                USB_Device_SendRemoteWakeup();
+            }
+        }
+#endif
+
+#ifdef NKRO_ENABLE
+        if (protocol_changed) {
+            protocol_changed = false;
+            /* BIOS or boot driver only reads boot keyboard interface */
+            if (!protocol_report) {
+                host_boot_protocol();
+            }
+        }
+#endif
+
         keyboard_task();
 
+        // send queued reports without waiting for next Start of Frame
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            Report_Task();
+        }
+
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
+        PROF_BEGIN(PROF_USB_TASK);
         USB_USBTask();
+        PROF_END(PROF_USB_TASK);
+#endif
+
+#ifdef SLEEP_ENABLE
+        // wake up on next timer tick or Start of Frame unless work is due now
+        if (keyboard_deadline()) {
+            sleep_idle();
+        }
 #endif
     }
 }
@@ -56,6 +56,11 @@ extern "C" {
 
 extern host_driver_t lufa_driver;
 
+/* reports lost by send buffer overflow or while not configured */
+extern uint16_t lufa_keyboard_dropped;
+extern uint16_t lufa_mouse_dropped;
+extern uint16_t lufa_extra_dropped;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,11 @@
+NATIVE_DIR = protocol/native
+
+OPT_DEFS += -DHOST_NATIVE
+
+SRC +=	$(NATIVE_DIR)/main.c \
+	$(NATIVE_DIR)/native.c \
+	$(NATIVE_DIR)/matrix.c \
+	$(NATIVE_DIR)/timer.c
+
+# Search Path
+VPATH += $(TOP_DIR)/$(NATIVE_DIR)
@@ -0,0 +1,28 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Stand-in for avr-libc <avr/io.h> on native build.
+ * No registers exist on host; modules which touch them are not built.
+ */
+#ifndef NATIVE_AVR_IO_H
+#define NATIVE_AVR_IO_H
+
+#include <stdint.h>
+
+/* status register: saved and restored around cli() but has no effect */
+static uint8_t SREG __attribute__ ((unused));
+
+#endif
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Boot protocol fallback check: when host sets boot protocol with keys held
+# in NKRO, keyboard sends an empty boot report at once so that no key is
+# left stuck in host, see host_boot_protocol() in common/host.c.
+#
+# Usage: check_boot.sh <nkro_target> <trace>...
+#
+# For each '<ms> boot' line of trace the last keyboard report at <ms> should
+# have no key, and a report with key should be sent before it.
+target=$1
+shift
+status=0
+for trace in "$@"; do
+    if $target -m -n < $trace 2>/dev/null | awk '
+        FNR == NR { if ($2 == "boot") boot[$1] = 1; next }
+        $2 == "keyboard:" {
+            keys = ""
+            for (i = 5; i <= NF; i++) keys = keys $i
+            empty = (keys ~ /^0*$/)
+            if (!empty) held = 1
+            if ($1 in boot) { last[$1] = empty; seen[$1] = held }
+        }
+        END {
+            ok = 1
+            for (t in boot) {
+                if (!(t in last)) { print "no report at boot " t; ok = 0 }
+                else if (!seen[t]) { print "no key held before boot " t; ok = 0 }
+                else if (!last[t]) { print "keys left at boot " t; ok = 0 }
+            }
+            exit !ok
+        }' $trace -
+    then
+        echo "$trace: OK"
+    else
+        echo "$trace: FAILED"
+        status=1
+    fi
+done
+exit $status
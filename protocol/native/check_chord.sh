@@ -0,0 +1,56 @@
+#!/bin/sh
+# Chord replay check: a build with KEYS_PER_SCAN=N gives host same keys as
+# KEYS_PER_SCAN=1(one event per keyboard_task pass).
+#
+# Usage: check_chord.sh <one_per_pass> <n_per_pass> <trace>...
+#
+# Keyboard reports of both are replayed through matrix(-m) and compared:
+#   - every keycode and mod bit seen with 1 are seen with N
+#   - reports with N are in the same order as with 1, those between
+#     are ones merged into a report of chord
+#   - final report is same
+one=$1
+many=$2
+shift 2
+status=0
+tmp=${TMPDIR:-/tmp}/check_chord.$$
+for trace in "$@"; do
+    $one -m < $trace 2>/dev/null | sed -n 's/^ *[0-9]* keyboard: //p' > $tmp.one
+    $many -m < $trace 2>/dev/null | sed -n 's/^ *[0-9]* keyboard: //p' > $tmp.many
+    if awk '
+        function hex(h,    i, n) {
+            n = 0
+            for (i = 1; i <= length(h); i++) n = n * 16 + index("0123456789ABCDEF", substr(h, i, 1)) - 1
+            return n
+        }
+        # "mods | keys...": mod bits and keycodes of report
+        function keys(line, seen,    f, n, i, m) {
+            n = split(line, f, " ")
+            m = hex(f[1])
+            for (i = 0; i < 8; i++) if (int(m / 2^i) % 2) seen["mod" i] = 1
+            for (i = 3; i <= n; i++) if (f[i] != "00") seen[f[i]] = 1
+        }
+        NR == FNR { one[++n1] = $0; keys($0, seen1); next }
+        { many[++n2] = $0; keys($0, seen2) }
+        END {
+            ok = 1
+            for (k in seen1) if (!(k in seen2)) { print "missing with N: " k; ok = 0 }
+            j = 1
+            for (i = 1; i <= n2; i++) {
+                while (j <= n1 && one[j] != many[i]) j++
+                if (j > n1) { print "out of order with N: " many[i]; ok = 0; break }
+                j++
+            }
+            if (one[n1] != many[n2]) { print "final differs: " one[n1] " / " many[n2]; ok = 0 }
+            printf "%d reports with 1, %d with N\n", n1, n2
+            exit !ok
+        }' $tmp.one $tmp.many
+    then
+        echo "$trace: OK"
+    else
+        echo "$trace: FAILED"
+        status=1
+    fi
+    rm -f $tmp.one $tmp.many
+done
+exit $status
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Macro assembler round trip check, see protocol/native/macro_asm.c.
+#
+# Usage: check_macro.sh <macro_asm> <macro.txt> <macro.bytes>
+#
+#   text->bytes->text:  text assembles into bytes, whose disassembly
+#                       assembles into the same bytes and disassembles
+#                       into the same text again
+#   bytes->text->bytes: disassembly of bytes assembles into the same bytes,
+#                       down/up pairs in a row are not repacked in TYPE_RUN
+asm=$1
+text=$2
+bytes=$3
+status=0
+tmp=${TMPDIR:-/tmp}/check_macro.$$
+
+$asm -a < $text > $tmp.b1 &&
+$asm -d < $tmp.b1 > $tmp.t1 &&
+$asm -a < $tmp.t1 > $tmp.b2 &&
+$asm -d < $tmp.b2 > $tmp.t2 &&
+cmp -s $tmp.b1 $tmp.b2 && cmp -s $tmp.t1 $tmp.t2
+if [ $? -eq 0 ]; then
+    echo "$text: text->bytes->text OK"
+else
+    echo "$text: text->bytes->text FAILED"
+    diff $tmp.b1 $tmp.b2
+    status=1
+fi
+
+# bytes in C initializer form of -a to compare with
+$asm -d < $bytes > $tmp.t1 &&
+tr -c '0-9A-Fa-fx\n' ' ' < $bytes | grep -o '0x[0-9A-Fa-f]*' | tr 'a-f' 'A-F' | sed 's/0X/0x/' > $tmp.b1 &&
+$asm -a < $tmp.t1 | grep -o '0x[0-9A-F]*' > $tmp.b2 &&
+cmp -s $tmp.b1 $tmp.b2
+if [ $? -eq 0 ]; then
+    echo "$bytes: bytes->text->bytes OK"
+else
+    echo "$bytes: bytes->text->bytes FAILED"
+    cat $tmp.t1
+    diff $tmp.b1 $tmp.b2
+    status=1
+fi
+
+rm -f $tmp.b1 $tmp.b2 $tmp.t1 $tmp.t2
+exit $status
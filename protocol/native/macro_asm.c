@@ -0,0 +1,470 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Macro assembler and disassembler on host
+ *
+ * Assembles text of macro commands in common/action_macro.h into bytes
+ * and disassembles bytes into the text again, so that macro can be kept
+ * readable and put into keymap in compact form. On assembling, runs of
+ * three or more T(key) are packed into TYPE_RUN and D/U/T of keycode out of
+ * 0x04-0x73 become EXT_DOWN/EXT_UP.
+ *
+ * Output of -d assembles into the same bytes again: down/up pairs not packed
+ * in TYPE_RUN are T(key) only when two or less in a row, and D(key), U(key)
+ * when three or more so that they are not packed on reassembling.
+ *
+ * Usage: macro_asm -a < macro.txt      print bytes as C initializer
+ *        macro_asm -d < bytes.txt      print commands
+ *
+ * Text is commands separated with comma or space as written in keymap,
+ * keycode names can have KC_ prefix or not. Output of -d is text of this
+ * form and also valid C with action_macro.h.
+ *     I(10), MD(LSHIFT), T(H), T(I), MU(LSHIFT), W(100),
+ *     LOOP(3), T(X), LOOP_END, ET(AUDIO_MUTE), END
+ * Bytes are numbers in C notation separated with anything else.
+ *
+ * Build: make -f Makefile.native macro_asm
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "keycode.h"
+#include "action_macro.h"
+
+
+#define MACRO_ASM_SIZE  4096
+
+typedef struct {
+    const char *name;
+    uint8_t     code;
+} keycode_name_t;
+
+/* generated from keycode.h, enum names first and then aliases */
+static const keycode_name_t keycode_names[] = {
+#include "macro_keycodes.h"
+};
+#define KEYCODE_NAMES   (sizeof(keycode_names) / sizeof(keycode_names[0]))
+
+static uint8_t bytes[MACRO_ASM_SIZE];
+static uint16_t len = 0;
+static unsigned line = 1;
+
+
+static bool keycode_of(const char *name, uint8_t *code)
+{
+    if (!strncmp(name, "KC_", 3)) name += 3;
+    for (uint16_t i = 0; i < KEYCODE_NAMES; i++) {
+        if (!strcmp(name, keycode_names[i].name)) {
+            *code = keycode_names[i].code;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *keycode_name(uint8_t code)
+{
+    for (uint16_t i = 0; i < KEYCODE_NAMES; i++) {
+        if (keycode_names[i].code == code) return keycode_names[i].name;
+    }
+    return NULL;
+}
+
+/* number in C notation or keycode name */
+static bool value_of(const char *s, uint8_t *value)
+{
+    if (isdigit((unsigned char)s[0])) {
+        char *end;
+        unsigned long n = strtoul(s, &end, 0);
+        if (*end || n > 0xFF) return false;
+        *value = n;
+        return true;
+    }
+    return keycode_of(s, value);
+}
+
+
+/*
+ * Assembler
+ */
+static bool emit(uint8_t b)
+{
+    if (len == MACRO_ASM_SIZE) {
+        fprintf(stderr, "line %u: macro too long\n", line);
+        return false;
+    }
+    bytes[len++] = b;
+    return true;
+}
+
+static uint8_t run[255];
+static uint8_t run_len = 0;
+
+/* T(key) are kept in run till other command comes */
+static bool run_flush(void)
+{
+    bool ok = true;
+    if (run_len >= 3) {
+        ok = emit(TYPE_RUN) && emit(run_len);
+        for (uint8_t i = 0; ok && i < run_len; i++) ok = emit(run[i]);
+    } else {
+        for (uint8_t i = 0; ok && i < run_len; i++) ok = emit(DOWN(run[i])) && emit(UP(run[i]));
+    }
+    run_len = 0;
+    return ok;
+}
+
+static bool is_code_key(uint8_t code)
+{
+    return (0x04 <= code && code <= 0x73);
+}
+
+/* reads a token: name, number or '(' ')', skipping separators and comments */
+static bool token(FILE *f, char *tok, size_t size)
+{
+    int c;
+    size_t n = 0;
+
+    while ((c = getc(f)) != EOF) {
+        if (c == '\n') line++;
+        if (c == '/') {
+            int next = getc(f);
+            if (next == '/') {
+                while ((c = getc(f)) != EOF && c != '\n') ;
+                line++;
+                continue;
+            } else if (next == '*') {
+                int prev = 0;
+                while ((c = getc(f)) != EOF && !(prev == '*' && c == '/')) {
+                    if (c == '\n') line++;
+                    prev = c;
+                }
+                continue;
+            }
+            ungetc(next, f);
+        }
+        if (isalnum(c) || c == '_' || c == '(' || c == ')') break;
+    }
+    if (c == EOF) return false;
+    if (c == '(' || c == ')') {
+        tok[0] = c; tok[1] = '\0';
+        return true;
+    }
+    do {
+        if (n + 1 < size) tok[n++] = c;
+    } while ((c = getc(f)) != EOF && (isalnum(c) || c == '_'));
+    if (c != EOF) ungetc(c, f);
+    tok[n] = '\0';
+    return true;
+}
+
+static bool argument(FILE *f, char *arg, size_t size)
+{
+    char paren[2];
+    return token(f, paren, sizeof(paren)) && paren[0] == '(' &&
+           token(f, arg, size) && isalnum((unsigned char)arg[0]) &&
+           token(f, paren, sizeof(paren)) && paren[0] == ')';
+}
+
+static bool assemble(FILE *f)
+{
+    char tok[64], arg[64];
+    uint8_t value;
+    uint8_t type_left = 0;
+    bool in_loop = false;
+
+    while (token(f, tok, sizeof(tok))) {
+        /* keycodes of TYPE_RUN and raw bytes */
+        if (type_left || isdigit((unsigned char)tok[0]) || !strncmp(tok, "KC_", 3)) {
+            if (!value_of(tok, &value)) goto BAD;
+            if (type_left && !is_code_key(value)) goto BAD;
+            if (type_left) type_left--;
+            if (!run_flush() || !emit(value)) return false;
+            continue;
+        }
+
+        /* commands without argument */
+        if (!strcmp(tok, "END") || !strcmp(tok, "MODS_PUSH") || !strcmp(tok, "MODS_POP") ||
+                !strcmp(tok, "LOOP_END")) {
+            if (!run_flush()) return false;
+            if (!strcmp(tok, "LOOP_END")) {
+                if (!in_loop) { fprintf(stderr, "line %u: LOOP_END without LOOP\n", line); return false; }
+                in_loop = false;
+                if (!emit(LOOP_END)) return false;
+            }
+            else if (!strcmp(tok, "END"))       { if (!emit(END)) return false; }
+            else if (!strcmp(tok, "MODS_PUSH")) { if (!emit(MODS_PUSH)) return false; }
+            else                                { if (!emit(MODS_POP)) return false; }
+            continue;
+        }
+
+        if (!argument(f, arg, sizeof(arg)) || !value_of(arg, &value)) goto BAD;
+
+        if (!strcmp(tok, "T") || !strcmp(tok, "TYPE")) {
+            if (is_code_key(value)) {
+                run[run_len++] = value;
+                if (run_len == sizeof(run) && !run_flush()) return false;
+                continue;
+            }
+            if (!run_flush() || !emit(EXT_DOWN) || !emit(value) || !emit(EXT_UP) || !emit(value)) return false;
+            continue;
+        }
+        if (!run_flush()) return false;
+
+        if (!strcmp(tok, "D") || !strcmp(tok, "DOWN")) {
+            if (!(is_code_key(value) ? emit(DOWN(value)) : (emit(EXT_DOWN) && emit(value)))) return false;
+        } else if (!strcmp(tok, "U") || !strcmp(tok, "UP")) {
+            if (!(is_code_key(value) ? emit(UP(value)) : (emit(EXT_UP) && emit(value)))) return false;
+        } else if (!strcmp(tok, "ED") || !strcmp(tok, "EXT_DOWN")) {
+            if (!emit(EXT_DOWN) || !emit(value)) return false;
+        } else if (!strcmp(tok, "EU") || !strcmp(tok, "EXT_UP")) {
+            if (!emit(EXT_UP) || !emit(value)) return false;
+        } else if (!strcmp(tok, "ET") || !strcmp(tok, "EXT_TYPE")) {
+            if (!emit(EXT_DOWN) || !emit(value) || !emit(EXT_UP) || !emit(value)) return false;
+        } else if (!strcmp(tok, "MD") || !strcmp(tok, "MU") || !strcmp(tok, "MS")) {
+            if (!IS_MOD(value)) goto BAD;
+            if (!emit(tok[1] == 'D' ? MODS_DOWN : tok[1] == 'U' ? MODS_UP : MODS_SET) ||
+                    !emit(MOD_BIT(value))) return false;
+        } else if (!strcmp(tok, "MODS_DOWN")) {
+            if (!emit(MODS_DOWN) || !emit(value)) return false;
+        } else if (!strcmp(tok, "MODS_UP")) {
+            if (!emit(MODS_UP) || !emit(value)) return false;
+        } else if (!strcmp(tok, "MODS_SET")) {
+            if (!emit(MODS_SET) || !emit(value)) return false;
+        } else if (!strcmp(tok, "W") || !strcmp(tok, "WAIT")) {
+            if (!emit(WAIT) || !emit(value)) return false;
+        } else if (!strcmp(tok, "I") || !strcmp(tok, "INTERVAL")) {
+            if (!emit(INTERVAL) || !emit(value)) return false;
+        } else if (!strcmp(tok, "TR") || !strcmp(tok, "TYPE_RUN")) {
+            if (!emit(TYPE_RUN) || !emit(value)) return false;
+            type_left = value;
+        } else if (!strcmp(tok, "LOOP")) {
+            if (in_loop) { fprintf(stderr, "line %u: LOOP can't be nested\n", line); return false; }
+            in_loop = true;
+            if (!emit(LOOP) || !emit(value)) return false;
+        } else {
+            goto BAD;
+        }
+    }
+    if (type_left) {
+        fprintf(stderr, "line %u: TYPE_RUN short of keycodes\n", line);
+        return false;
+    }
+    if (in_loop) {
+        fprintf(stderr, "line %u: LOOP without LOOP_END\n", line);
+        return false;
+    }
+    if (!run_flush()) return false;
+    if (!len || bytes[len - 1] != END) return emit(END);
+    return true;
+BAD:
+    fprintf(stderr, "line %u: bad command or argument: %s\n", line, tok);
+    return false;
+}
+
+static void print_bytes(void)
+{
+    printf("/* %u bytes */\n", len);
+    for (uint16_t i = 0; i < len; i++) {
+        printf("%s0x%02X,%s", (i % 12 ? " " : "    "), bytes[i], (i % 12 == 11 || i == len - 1 ? "\n" : ""));
+    }
+}
+
+
+/*
+ * Disassembler
+ */
+static bool read_bytes(FILE *f)
+{
+    char tok[64];
+    uint8_t value;
+
+    while (token(f, tok, sizeof(tok))) {
+        if (!isdigit((unsigned char)tok[0]) || !value_of(tok, &value)) {
+            fprintf(stderr, "line %u: bad byte: %s\n", line, tok);
+            return false;
+        }
+        if (!emit(value)) return false;
+    }
+    return true;
+}
+
+static uint16_t column = 0;
+
+static void out(const char *fmt, const char *name, unsigned value)
+{
+    char s[64];
+    if (name) {
+        snprintf(s, sizeof(s), fmt, name);
+    } else {
+        snprintf(s, sizeof(s), fmt, value);
+    }
+    if (column && column + strlen(s) + 2 > 76) {
+        printf(",\n");
+        column = 0;
+    } else if (column) {
+        printf(", ");
+        column += 2;
+    }
+    if (!column) {
+        printf("    ");
+        column = 4;
+    }
+    printf("%s", s);
+    column += strlen(s);
+}
+
+/* key command with name of keycode or long form with number */
+static void out_key(const char *short_fmt, const char *long_fmt, uint8_t code)
+{
+    const char *name = keycode_name(code);
+    if (name) {
+        out(short_fmt, name, 0);
+    } else {
+        out(long_fmt, NULL, code);
+    }
+}
+
+static void out_mods(const char *short_fmt, const char *long_fmt, uint8_t mods)
+{
+    if (mods && !(mods & (mods - 1))) {
+        uint8_t index = 0;
+        while (!(mods & (1<<index))) index++;
+        out_key(short_fmt, long_fmt, KC_LCTRL + index);
+    } else {
+        out(long_fmt, NULL, mods);
+    }
+}
+
+/* number of key down/up pairs in a row from bytes[i] */
+static uint16_t type_pairs(uint16_t i)
+{
+    uint16_t n = 0;
+    while (i + 1 < len && 0x04 <= bytes[i] && bytes[i] <= 0x73 && bytes[i + 1] == UP(bytes[i])) {
+        n++;
+        i += 2;
+    }
+    return n;
+}
+
+static bool disassemble(void)
+{
+    uint16_t i = 0;
+    uint16_t split = 0;     /* pairs left to print as D/U not to be packed */
+    bool truncated = false;
+
+#define OPERAND() (i < len ? bytes[i++] : (truncated = true, 0))
+    while (i < len) {
+        uint8_t b = bytes[i++];
+        switch (b) {
+            case END:
+                out("END", NULL, 0);
+                break;
+            case MODS_DOWN:
+                out_mods("MD(%s)", "MODS_DOWN(0x%02X)", OPERAND());
+                break;
+            case MODS_UP:
+                out_mods("MU(%s)", "MODS_UP(0x%02X)", OPERAND());
+                break;
+            case MODS_SET:
+                out_mods("MS(%s)", "MODS_SET(0x%02X)", OPERAND());
+                break;
+            case WAIT:
+                out("W(%u)", NULL, OPERAND());
+                break;
+            case INTERVAL:
+                out("I(%u)", NULL, OPERAND());
+                break;
+            case MODS_PUSH:
+                out("MODS_PUSH", NULL, 0);
+                break;
+            case MODS_POP:
+                out("MODS_POP", NULL, 0);
+                break;
+            case EXT_DOWN:
+                if (i + 2 < len && bytes[i + 1] == EXT_UP && bytes[i + 2] == bytes[i]) {
+                    out_key("ET(%s)", "EXT_TYPE(0x%02X)", bytes[i]);
+                    i += 3;
+                } else {
+                    out_key("ED(%s)", "EXT_DOWN(0x%02X)", OPERAND());
+                }
+                break;
+            case EXT_UP:
+                out_key("EU(%s)", "EXT_UP(0x%02X)", OPERAND());
+                break;
+            case TYPE_RUN:
+                {
+                    uint8_t n = OPERAND();
+                    out("TR(%u)", NULL, n);
+                    while (n--) out_key("KC_%s", "0x%02X", OPERAND());
+                }
+                break;
+            case LOOP:
+                out("LOOP(%u)", NULL, OPERAND());
+                break;
+            case LOOP_END:
+                out("LOOP_END", NULL, 0);
+                break;
+            case 0x04 ... 0x73:
+                if (!split && type_pairs(i - 1) >= 3) split = type_pairs(i - 1);
+                if (split) {
+                    out_key("D(%s)", "DOWN(0x%02X)", b);
+                    out_key("U(%s)", "UP(0x%02X)", b);
+                    split--;
+                    i++;
+                } else if (i < len && bytes[i] == UP(b)) {
+                    out_key("T(%s)", "TYPE(0x%02X)", b);
+                    i++;
+                } else {
+                    out_key("D(%s)", "DOWN(0x%02X)", b);
+                }
+                break;
+            case 0x84 ... 0xF3:
+                out_key("U(%s)", "UP(0x%02X)", b & 0x7F);
+                break;
+            default:
+                out("0x%02X", NULL, b);
+                break;
+        }
+    }
+#undef OPERAND
+    if (column) printf("\n");
+    if (truncated) {
+        fprintf(stderr, "operand missing at end\n");
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "-a")) {
+        if (!assemble(stdin)) return 1;
+        print_bytes();
+        return 0;
+    }
+    if (argc == 2 && !strcmp(argv[1], "-d")) {
+        if (!read_bytes(stdin)) return 1;
+        return (disassemble() ? 0 : 1);
+    }
+    fprintf(stderr, "usage: %s -a|-d < input\n", argv[0]);
+    return 1;
+}
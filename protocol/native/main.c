@@ -0,0 +1,307 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Native main: replays a key event trace through the action engine, prints
+ * reports sent to host with their time and reports latency from event to
+ * report and reports sent per event.
+ *
+ * Trace lines:
+ *     <ms> <row> <col> <0|1>   release/press switch at time <ms>
+ *     <ms> boot                host sets boot protocol(NKRO_ENABLE)
+ *     # ...                    comment
+ * Lines must be sorted by time.
+ *
+ * Usage: <target> [-m] [-q] [-n] < trace
+ *     -m   feed events through simulated matrix and keyboard_task()
+ *          instead of calling action_exec() directly
+ *     -q   print summary only
+ *     -n   start with NKRO(NKRO_ENABLE)
+ *
+ * Latency of event is time till first report sent in the step(ms) its
+ * action is performed, events whose action sends no report(layer keys)
+ * are left out of latency summary.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "keyboard.h"
+#include "action.h"
+#include "host.h"
+#include "timer.h"
+#include "native.h"
+
+
+/* time to run after last event to let pending taps settle(ms) */
+#ifndef NATIVE_SETTLE_TIME
+#   define NATIVE_SETTLE_TIME   1000
+#endif
+
+/* max number of events in a trace */
+#ifndef NATIVE_TRACE_SIZE
+#   define NATIVE_TRACE_SIZE    65536
+#endif
+
+
+typedef struct {
+    uint32_t time;
+    key_t    key;
+    bool     pressed;
+    bool     processed;
+    bool     reported;
+    uint32_t latency;
+    uint16_t reports;
+} trace_event_t;
+
+/* max number of events processed in a step */
+#ifndef NATIVE_STEP_EVENTS
+#   define NATIVE_STEP_EVENTS   64
+#endif
+
+/* NOTE: <stdlib.h> and <unistd.h> are avoided as their key_t collides with ours */
+static trace_event_t trace[NATIVE_TRACE_SIZE];
+static uint32_t trace_len = 0;
+static uint32_t trace_pending = 0;  /* first event not processed yet */
+static uint32_t trace_last = 0;     /* last processed event */
+static uint32_t step_events[NATIVE_STEP_EVENTS];    /* processed in this step */
+static uint8_t step_events_len = 0;
+static bool quiet = false;
+
+/* max number of boot protocol requests in a trace */
+#ifndef NATIVE_BOOT_SIZE
+#   define NATIVE_BOOT_SIZE     16
+#endif
+static uint32_t boot[NATIVE_BOOT_SIZE];
+static uint8_t boot_len = 0;
+
+
+static bool trace_read(FILE *f)
+{
+    char line[80];
+    unsigned long ms;
+    unsigned row, col, on;
+    char word[8];
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%lu %7s", &ms, word) == 2 && !strcmp(word, "boot")) {
+            if (boot_len == NATIVE_BOOT_SIZE) {
+                fprintf(stderr, "trace: too many boot\n");
+                return false;
+            }
+            boot[boot_len++] = ms;
+            continue;
+        }
+        if (sscanf(line, "%lu %u %u %u", &ms, &row, &col, &on) != 4) continue;
+        if (trace_len && ms < trace[trace_len - 1].time) {
+            fprintf(stderr, "trace: not sorted at %lu\n", ms);
+            return false;
+        }
+        if (trace_len == NATIVE_TRACE_SIZE) {
+            fprintf(stderr, "trace: too many events\n");
+            return false;
+        }
+        trace[trace_len++] = (trace_event_t){
+            .time = ms,
+            .key = (key_t){ .row = row, .col = col },
+            .pressed = on
+        };
+    }
+    return true;
+}
+
+static void print_report(native_report_t *r)
+{
+    printf("%8lu ", (unsigned long)r->time);
+    switch (r->kind) {
+        case NATIVE_REPORT_KEYBOARD:
+            printf("keyboard: %02X |", r->keyboard.mods);
+            for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+                printf(" %02X", r->keyboard.keys[i]);
+            }
+            printf("\n");
+            break;
+        case NATIVE_REPORT_MOUSE:
+            printf("mouse: %02X %d %d %d %d\n", r->mouse.buttons,
+                    r->mouse.x, r->mouse.y, r->mouse.v, r->mouse.h);
+            break;
+        case NATIVE_REPORT_SYSTEM:
+            printf("system: %04X\n", r->usage);
+            break;
+        case NATIVE_REPORT_CONSUMER:
+            printf("consumer: %04X\n", r->usage);
+            break;
+    }
+}
+
+/* attributes performed action to oldest pending trace event of the key */
+void action_processed(keyrecord_t *record)
+{
+    for (uint32_t i = trace_pending; i < trace_len && trace[i].time <= timer_read32(); i++) {
+        trace_event_t *t = &trace[i];
+        if (!t->processed && KEYEQ(t->key, record->event.key) && t->pressed == record->event.pressed) {
+            t->processed = true;
+            trace_last = i;
+            if (step_events_len < NATIVE_STEP_EVENTS) {
+                step_events[step_events_len++] = i;
+            }
+            break;
+        }
+    }
+    while (trace_pending < trace_len && trace[trace_pending].processed) {
+        trace_pending++;
+    }
+}
+
+/*
+ * Takes reports sent in this step: first of them gives latency of events
+ * processed in the step, all are counted for last processed event as they
+ * are merged into one report or come from timed jobs(mousekey, macro).
+ */
+static void step_reports(void)
+{
+    uint16_t count = native_report_count();
+
+    if (count) {
+        uint32_t sent = native_report_get(0)->time;
+        for (uint8_t i = 0; i < step_events_len; i++) {
+            trace_event_t *t = &trace[step_events[i]];
+            t->reported = true;
+            t->latency = sent - t->time;
+        }
+        trace[trace_last].reports += count;
+        if (!quiet) {
+            for (uint16_t i = 0; i < count; i++) {
+                print_report(native_report_get(i));
+            }
+        }
+        native_report_clear();
+    }
+    step_events_len = 0;
+}
+
+int main(int argc, char **argv)  __attribute__ ((weak));
+int main(int argc, char **argv)
+{
+    bool matrix_mode = false;
+    bool nkro = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-m")) {
+            matrix_mode = true;
+        } else if (!strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (!strcmp(argv[i], "-n")) {
+            nkro = true;
+        } else {
+            fprintf(stderr, "usage: %s [-m] [-q] [-n] < trace\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!trace_read(stdin)) return 1;
+    if (!trace_len) return 0;
+
+    keyboard_init();
+    host_set_driver(native_driver());
+#ifdef NKRO_ENABLE
+    keyboard_nkro = nkro;
+#else
+    if (nkro || boot_len) fprintf(stderr, "native: NKRO_ENABLE is not defined\n");
+#endif
+
+    uint32_t next = 0;
+    uint8_t next_boot = 0;
+    uint32_t end = trace[trace_len - 1].time + NATIVE_SETTLE_TIME;
+    uint32_t steps = 0;
+    uint32_t wb_sum = 0;
+    uint8_t  wb_max = 0;
+    for (uint32_t now = trace[0].time; now <= end; now++) {
+        native_timer_set(now);
+
+        // SET_PROTOCOL is handled before keyboard_task() as in lufa main loop
+        for (; next_boot < boot_len && boot[next_boot] <= now; next_boot++) {
+#ifdef NKRO_ENABLE
+            host_boot_protocol();
+#endif
+        }
+
+        bool fed = false;
+        for (; next < trace_len && trace[next].time == now; next++) {
+            if (matrix_mode) {
+                native_matrix_set(trace[next].key.row, trace[next].key.col, trace[next].pressed);
+            } else {
+                action_exec((keyevent_t){
+                    .key = trace[next].key,
+                    .pressed = trace[next].pressed,
+                    .time = (now | 1)
+                });
+                fed = true;
+            }
+        }
+        if (matrix_mode) {
+#ifdef MATRIX_SCAN_ISR
+            // timer interrupt
+            keyboard_scan();
+#endif
+            keyboard_task();
+        } else {
+            if (!fed) action_exec(TICK);
+            host_flush_keyboard_report();
+        }
+        step_reports();
+
+        uint8_t wb = waiting_buffer_count();
+        wb_sum += wb;
+        if (wb > wb_max) wb_max = wb;
+        steps++;
+    }
+
+    uint32_t processed = 0, reported = 0, latency_sum = 0, latency_max = 0, reports = 0;
+    for (uint32_t i = 0; i < trace_len; i++) {
+        trace_event_t *t = &trace[i];
+        if (!quiet) {
+            printf("%8lu %02X%02X %c", (unsigned long)t->time, t->key.row, t->key.col, t->pressed ? 'd' : 'u');
+            if (t->reported) {
+                printf(" latency: %4lu reports: %u\n", (unsigned long)t->latency, t->reports);
+            } else if (t->processed) {
+                printf(" no report     reports: %u\n", t->reports);
+            } else {
+                printf(" not processed\n");
+            }
+        }
+        if (!t->processed) continue;
+        processed++;
+        reports += t->reports;
+        if (!t->reported) continue;
+        reported++;
+        latency_sum += t->latency;
+        if (t->latency > latency_max) latency_max = t->latency;
+    }
+
+    printf("events: %lu processed: %lu reports: %lu\n",
+            (unsigned long)trace_len, (unsigned long)processed, (unsigned long)reports);
+    if (reported) {
+        printf("latency(ms): avg %.2f max %lu events with report: %lu\n",
+                (double)latency_sum / reported, (unsigned long)latency_max, (unsigned long)reported);
+    }
+    if (processed) {
+        printf("reports/event: %.2f\n", (double)reports / processed);
+    }
+    printf("waiting_buffer: avg %.2f max %u\n", (double)wb_sum / steps, wb_max);
+    return 0;
+}
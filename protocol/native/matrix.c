@@ -0,0 +1,126 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * simulated matrix: switch states are set by native_matrix_set()
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "print.h"
+#include "util.h"
+#include "matrix.h"
+#include "native.h"
+
+
+static matrix_row_t matrix[MATRIX_ROWS];
+static uint32_t scan_count = 0;
+/* rows changed by native_matrix_set() since last matrix_dirty_rows() */
+static matrix_dirty_t dirty = 0;
+
+
+inline
+uint8_t matrix_rows(void)
+{
+    return MATRIX_ROWS;
+}
+
+inline
+uint8_t matrix_cols(void)
+{
+    return MATRIX_COLS;
+}
+
+void matrix_init(void)
+{
+    native_matrix_clear();
+}
+
+uint8_t matrix_scan(void)
+{
+    scan_count++;
+    return 1;
+}
+
+bool matrix_is_modified(void)
+{
+    return true;
+}
+
+matrix_dirty_t matrix_dirty_rows(void)
+{
+    matrix_dirty_t d = dirty;
+    dirty = 0;
+    return d;
+}
+
+bool matrix_has_ghost(void)
+{
+    return false;
+}
+
+bool matrix_is_on(uint8_t row, uint8_t col)
+{
+    return (matrix[row] & ((matrix_row_t)1<<col));
+}
+
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+void matrix_print(void)
+{
+    print("\nr/c 0123456789ABCDEF\n");
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        phex(row); print(": ");
+        pbin_reverse16(matrix_get_row(row));
+        print("\n");
+    }
+}
+
+uint8_t matrix_key_count(void)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        for (matrix_row_t r = matrix[i]; r; r &= r - 1) count++;
+    }
+    return count;
+}
+
+void native_matrix_set(uint8_t row, uint8_t col, bool on)
+{
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
+    dirty |= ((matrix_dirty_t)1<<row);
+    if (on) {
+        matrix[row] |= ((matrix_row_t)1<<col);
+    } else {
+        matrix[row] &= ~((matrix_row_t)1<<col);
+    }
+}
+
+void native_matrix_clear(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+    }
+    dirty = MATRIX_DIRTY_ALL;
+}
+
+uint32_t native_matrix_scan_count(void)
+{
+    return scan_count;
+}
@@ -0,0 +1,133 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "host.h"
+#include "timer.h"
+#include "led.h"
+#include "sendchar.h"
+#include "bootloader.h"
+#include "native.h"
+
+
+/*------------------------------------------------------------------*
+ * Host driver
+ *------------------------------------------------------------------*/
+static native_report_t report_log[NATIVE_REPORT_LOG_SIZE];
+static uint16_t report_count = 0;
+static uint8_t leds = 0;
+
+static uint8_t keyboard_leds(void);
+static void send_keyboard(report_keyboard_t *report);
+static void send_mouse(report_mouse_t *report);
+static void send_system(uint16_t data);
+static void send_consumer(uint16_t data);
+
+static host_driver_t driver = {
+        keyboard_leds,
+        send_keyboard,
+        send_mouse,
+        send_system,
+        send_consumer
+};
+
+host_driver_t *native_driver(void)
+{
+    return &driver;
+}
+
+uint16_t native_report_count(void)
+{
+    return report_count;
+}
+
+native_report_t *native_report_get(uint16_t index)
+{
+    if (index >= report_count) return NULL;
+    return &report_log[index];
+}
+
+void native_report_clear(void)
+{
+    report_count = 0;
+}
+
+void native_set_leds(uint8_t l)
+{
+    leds = l;
+}
+
+static native_report_t *report_new(uint8_t kind)
+{
+    if (report_count >= NATIVE_REPORT_LOG_SIZE) {
+        fprintf(stderr, "native: report log full\n");
+        return NULL;
+    }
+    native_report_t *r = &report_log[report_count++];
+    r->kind = kind;
+    r->time = timer_read32();
+    return r;
+}
+
+static uint8_t keyboard_leds(void)
+{
+    return leds;
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    native_report_t *r = report_new(NATIVE_REPORT_KEYBOARD);
+    if (r) r->keyboard = *report;
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+    native_report_t *r = report_new(NATIVE_REPORT_MOUSE);
+    if (r) r->mouse = *report;
+}
+
+static void send_system(uint16_t data)
+{
+    native_report_t *r = report_new(NATIVE_REPORT_SYSTEM);
+    if (r) r->usage = data;
+}
+
+static void send_consumer(uint16_t data)
+{
+    native_report_t *r = report_new(NATIVE_REPORT_CONSUMER);
+    if (r) r->usage = data;
+}
+
+
+/*------------------------------------------------------------------*
+ * Board stubs
+ *------------------------------------------------------------------*/
+int8_t sendchar(uint8_t c)
+{
+    fputc(c, stderr);
+    return 0;
+}
+
+void led_set(uint8_t usb_led)
+{
+}
+
+void bootloader_jump(void)
+{
+    fprintf(stderr, "native: bootloader_jump\n");
+}
@@ -0,0 +1,70 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+#include "host_driver.h"
+
+
+/* kind of recorded report */
+enum native_report_kind {
+    NATIVE_REPORT_KEYBOARD,
+    NATIVE_REPORT_MOUSE,
+    NATIVE_REPORT_SYSTEM,
+    NATIVE_REPORT_CONSUMER,
+};
+
+/* report sent to host with time of sending */
+typedef struct {
+    uint8_t  kind;
+    uint32_t time;
+    union {
+        report_keyboard_t keyboard;
+        report_mouse_t    mouse;
+        uint16_t          usage;
+    };
+} native_report_t;
+
+#ifndef NATIVE_REPORT_LOG_SIZE
+#   define NATIVE_REPORT_LOG_SIZE   1024
+#endif
+
+
+/* host driver which records reports instead of sending */
+host_driver_t *native_driver(void);
+/* number of reports recorded since last clear */
+uint16_t native_report_count(void);
+/* recorded report of index, NULL if out of range */
+native_report_t *native_report_get(uint16_t index);
+void native_report_clear(void);
+/* LED state returned to keyboard as if set by host */
+void native_set_leds(uint8_t leds);
+
+/* simulated matrix */
+void native_matrix_set(uint8_t row, uint8_t col, bool on);
+void native_matrix_clear(void);
+uint32_t native_matrix_scan_count(void);
+
+/* simulated timer: time moves only when told to */
+void native_timer_set(uint32_t ms);
+void native_timer_advance(uint32_t ms);
+
+#endif
@@ -0,0 +1,107 @@
+# Build rules for native(host) target
+#
+# Compiles common/ and protocol/native/ with host gcc so that keyboard_task()
+# and the action engine can be run, tested and profiled off-target.
+# Include this instead of $(TOP_DIR)/rules.mk.
+
+# AVR only modules replaced by protocol/native
+SRC := $(filter-out $(COMMON_DIR)/timer.c $(COMMON_DIR)/bootloader.c $(COMMON_DIR)/debounce.c $(COMMON_DIR)/matrix_pipeline.c,$(SRC))
+
+OBJDIR = obj_$(TARGET)
+
+OPT = 2
+
+CC = gcc
+REMOVE = rm -f
+
+CFLAGS = -g
+CFLAGS += -DF_CPU=$(F_CPU)UL
+CFLAGS += $(OPT_DEFS)
+CFLAGS += -O$(OPT)
+CFLAGS += -funsigned-char
+CFLAGS += -funsigned-bitfields
+CFLAGS += -ffunction-sections
+# variables are defined in some headers(mousekey.h)
+CFLAGS += -fcommon
+CFLAGS += -Wall
+CFLAGS += -Wstrict-prototypes
+CFLAGS += $(patsubst %,-I%,$(subst :, ,$(VPATH)))
+CFLAGS += -std=gnu99
+CFLAGS += $(EXTRAFLAGS)
+ifdef CONFIG_H
+    CFLAGS += -include $(CONFIG_H)
+endif
+
+# drop weak legacy keymap functions left unreferenced(common/keymap.c)
+LDFLAGS = -Wl,--gc-sections
+LDFLAGS += $(EXTRALDFLAGS)
+
+OBJ = $(patsubst %.c,$(OBJDIR)/%.o,$(SRC))
+
+GENDEPFLAGS = -MMD -MP -MF .dep/$(@F).d
+
+
+all: $(TARGET)
+
+$(TARGET): $(OBJ)
+	$(CC) $(CFLAGS) $^ -o $@ $(LDFLAGS)
+
+$(OBJDIR)/%.o : %.c
+	@mkdir -p $(@D)
+	$(CC) -c $(CFLAGS) $(GENDEPFLAGS) $< -o $@
+
+# macro assembler/disassembler, see protocol/native/macro_asm.c
+# keycode names are taken from enum and aliases in keycode.h
+macro_asm: $(TOP_DIR)/protocol/native/macro_asm.c $(TOP_DIR)/$(COMMON_DIR)/keycode.h $(TOP_DIR)/$(COMMON_DIR)/action_macro.h
+	@mkdir -p $(OBJDIR)
+	sed -n -e '/^#if 0/,/^#endif/d' -e 's/^ *KC_\([A-Z0-9_]*\).*/    { "\1", KC_\1 },/p' \
+		$(TOP_DIR)/$(COMMON_DIR)/keycode.h > $(OBJDIR)/macro_keycodes.h
+	sed -n -e 's/^#define KC_\([A-Z0-9_]*\) *KC_.*/    { "\1", KC_\1 },/p' \
+		$(TOP_DIR)/$(COMMON_DIR)/keycode.h >> $(OBJDIR)/macro_keycodes.h
+	$(CC) $(CFLAGS) -I$(OBJDIR) $< -o $@
+
+# macro assembler round trip check, see protocol/native/check_macro.sh
+CHECK_MACRO_TEXT ?= $(TOP_DIR)/protocol/native/macro.txt
+CHECK_MACRO_BYTES ?= $(TOP_DIR)/protocol/native/macro.bytes
+check_macro: macro_asm
+	sh $(TOP_DIR)/protocol/native/check_macro.sh ./macro_asm $(CHECK_MACRO_TEXT) $(CHECK_MACRO_BYTES)
+
+# chord replay check: KEYS_PER_SCAN=1 and KEYS_PER_SCAN=$(CHECK_KEYS_PER_SCAN)
+# should give host same keys, see protocol/native/check_chord.sh
+CHECK_KEYS_PER_SCAN ?= 6
+CHECK_CHORD_TRACES ?= $(TOP_DIR)/protocol/native/chord.trace
+check_chord:
+	$(REMOVE) -r obj_$(TARGET)_kps*
+	$(MAKE) -f $(firstword $(MAKEFILE_LIST)) TARGET=$(TARGET)_kps1 \
+		EXTRAFLAGS="$(EXTRAFLAGS) -DKEYS_PER_SCAN=1"
+	$(MAKE) -f $(firstword $(MAKEFILE_LIST)) TARGET=$(TARGET)_kps$(CHECK_KEYS_PER_SCAN) \
+		EXTRAFLAGS="$(EXTRAFLAGS) -DKEYS_PER_SCAN=$(CHECK_KEYS_PER_SCAN)"
+	sh $(TOP_DIR)/protocol/native/check_chord.sh ./$(TARGET)_kps1 ./$(TARGET)_kps$(CHECK_KEYS_PER_SCAN) \
+		$(CHECK_CHORD_TRACES)
+
+# boot protocol fallback check: SET_PROTOCOL(boot) with keys held in NKRO
+# should send empty boot report, see protocol/native/check_boot.sh
+CHECK_BOOT_TRACES ?= $(TOP_DIR)/protocol/native/boot.trace
+check_boot:
+	$(REMOVE) -r obj_$(TARGET)_nkro
+	$(MAKE) -f $(firstword $(MAKEFILE_LIST)) TARGET=$(TARGET)_nkro \
+		EXTRAFLAGS="$(EXTRAFLAGS) -DNKRO_ENABLE"
+	sh $(TOP_DIR)/protocol/native/check_boot.sh ./$(TARGET)_nkro $(CHECK_BOOT_TRACES)
+
+clean:
+	$(REMOVE) $(TARGET)
+	$(REMOVE) $(TARGET)_kps*
+	$(REMOVE) -r obj_$(TARGET)_kps*
+	$(REMOVE) $(TARGET)_nkro
+	$(REMOVE) -r obj_$(TARGET)_nkro
+	$(REMOVE) macro_asm
+	$(REMOVE) -r $(OBJDIR)
+	$(REMOVE) -r .dep
+
+show_path:
+	@echo VPATH=$(VPATH)
+	@echo SRC=$(SRC)
+
+-include $(shell mkdir .dep 2>/dev/null) $(wildcard .dep/*)
+
+.PHONY : all clean show_path check_chord check_macro check_boot
@@ -0,0 +1,26 @@
+/*
+Copyright 2013 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Stand-in for avr-libc <util/delay.h> on native build.
+ * Busy-waits return at once; time is advanced only by native_timer_advance().
+ */
+#ifndef NATIVE_UTIL_DELAY_H
+#define NATIVE_UTIL_DELAY_H
+
+#define _delay_ms(ms)   ((void)(ms))
+#define _delay_us(us)   ((void)(us))
+
+#endif
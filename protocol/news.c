@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "news.h"
+#include "perf.h"
 
 
 void news_init(void)
@@ -71,6 +72,10 @@ ISR(NEWS_KBD_RX_VECT)
     if (next != rbuf_tail) {
         rbuf[rbuf_head] = NEWS_KBD_RX_DATA;
         rbuf_head = next;
+        PERF_COUNT(PERF_RECV);
+        PERF_MAX(PERF_MAX_RECV, (rbuf_head - rbuf_tail + RBUF_SIZE) % RBUF_SIZE);
+    } else {
+        PERF_COUNT(PERF_RECV_DROPPED);
     }
 }
 
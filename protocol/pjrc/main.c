@@ -37,6 +37,10 @@
 #endif
 #include "host.h"
 #include "pjrc.h"
+#include "boot.h"
+#ifdef SLEEP_ENABLE
+#   include "sleep.h"
+#endif
 
 
 #define CPU_PRESCALE(n)    (CLKPR = 0x80, CLKPR = (n))
@@ -47,15 +51,22 @@ int main(void)
     // set for 16 MHz clock
     CPU_PRESCALE(0);
 
-    // Initialize the USB, and then wait for the host to set configuration.
-    // If the Teensy is powered without a PC connected to the USB port,
-    // this will wait forever.
+    // Initialize the USB and keyboard while the host sets configuration.
+    // Reports are not sent until it is configured.
     usb_init();
-    while (!usb_configured()) /* wait */ ;
+    boot_phase_begin(BOOT_USB);
 
     keyboard_init();
     host_set_driver(pjrc_driver());
     while (1) {
+       if (boot_phase_running(BOOT_USB) && usb_configured()) {
+           boot_phase_end(BOOT_USB);
+       }
        keyboard_task(); 
+#ifdef SLEEP_ENABLE
+       if (keyboard_deadline()) {
+           sleep_idle();
+       }
+#endif
     }
 }
@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <util/delay.h>
 #include "ps2.h"
 #include "debug.h"
+#include "perf.h"
 
 
 static uint8_t recv_data(void);
@@ -196,7 +197,10 @@ static inline void pbuf_enqueue(uint8_t data)
     if (next != pbuf_tail) {
         pbuf[pbuf_head] = data;
         pbuf_head = next;
+        PERF_COUNT(PERF_RECV);
+        PERF_MAX(PERF_MAX_RECV, (pbuf_head - pbuf_tail + PBUF_SIZE) % PBUF_SIZE);
     } else {
+        PERF_COUNT(PERF_RECV_DROPPED);
         debug("pbuf: full\n");
     }
     SREG = sreg;
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include<util/delay.h>
 #include "ps2.h"
 #include "ps2_mouse.h"
+#include "timer.h"
 #include "usb_mouse.h"
 
 #define PS2_MOUSE_DEBUG
@@ -60,6 +61,11 @@ uint8_t ps2_mouse_btn = 0;
 uint8_t ps2_mouse_error_count = 0;
 
 static uint8_t ps2_mouse_btn_prev = 0;
+/* waiting for BAT after reset */
+static bool bat_waiting = false;
+static uint16_t bat_timer = 0;
+
+static uint8_t ps2_mouse_init_after_bat(void);
 
 
 uint8_t ps2_mouse_init(void) {
@@ -81,8 +87,27 @@ uint8_t ps2_mouse_init(void) {
     phex(rcv); phex(ps2_error); print("\n");
     ERROR_RETURN();
 
-    // BAT takes some time
-    _delay_ms(100);
+    // BAT takes some time, rest is done by ps2_mouse_init_task()
+    bat_waiting = true;
+    bat_timer = timer_read();
+    return 0;
+}
+
+/* run from main loop after init. returns true when init is over. */
+bool ps2_mouse_init_task(void)
+{
+    if (!bat_waiting) return true;
+    if (timer_elapsed(bat_timer) < 100) return false;
+
+    bat_waiting = false;
+    ps2_mouse_init_after_bat();
+    return true;
+}
+
+static uint8_t ps2_mouse_init_after_bat(void)
+{
+    uint8_t rcv;
+
     rcv = ps2_host_recv();
     print("ps2_mouse_init: read BAT: ");
     phex(rcv); phex(ps2_error); print("\n");
@@ -36,6 +36,7 @@ extern uint8_t ps2_mouse_btn;
 extern uint8_t ps2_mouse_error_count;
 
 uint8_t ps2_mouse_init(void);
+bool ps2_mouse_init_task(void);
 uint8_t ps2_mouse_read(void);
 bool ps2_mouse_changed(void);
 void ps2_mouse_usb_send(void);
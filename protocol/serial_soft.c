@@ -40,6 +40,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "serial.h"
+#include "perf.h"
 
 /*
  *  Stupid Inefficient Busy-wait Software Serial
@@ -133,6 +134,10 @@ ISR(SERIAL_RXD_VECT)
     if (next != rbuf_tail) {
         rbuf[rbuf_head] = data;
         rbuf_head = next;
+        PERF_COUNT(PERF_RECV);
+        PERF_MAX(PERF_MAX_RECV, (rbuf_head - rbuf_tail + RBUF_SIZE) % RBUF_SIZE);
+    } else {
+        PERF_COUNT(PERF_RECV_DROPPED);
     }
 
     SERIAL_RXD_INT_EXIT();
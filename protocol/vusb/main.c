@@ -20,6 +20,10 @@
 #include "timer.h"
 #include "uart.h"
 #include "debug.h"
+#include "boot.h"
+#ifdef SLEEP_ENABLE
+#   include "sleep.h"
+#endif
 
 
 #define UART_BAUD_RATE 115200
@@ -57,6 +61,7 @@ int main(void)
     host_set_driver(vusb_driver());
 
     debug("initForUsbConnectivity()\n");
+    boot_phase_begin(BOOT_USB);
     initForUsbConnectivity();
 
     debug("main loop\n");
@@ -70,24 +75,19 @@ int main(void)
             // Suspend when no SOF in 3ms-10ms(7.1.7.4 Suspending of USB1.1)
             if (timer_elapsed(last_timer) > 5) {
                 suspended = true;
-/*
-                uart_putchar('S');
-                _delay_ms(1);
-                cli();
-                set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-                sleep_enable();
-                sleep_bod_disable();
-                sei();
-                sleep_cpu();
-                sleep_disable();
-                _delay_ms(10);
-                uart_putchar('W');
-*/
+#ifdef SLEEP_ENABLE
+                // Only level interrupt of INT0 wakes from power down and D+ edge of
+                // host resume would be missed, so doze in idle until SOF comes back.
+                sleep_idle();
+#endif
             }
         }
 #endif
         if (!suspended) {
             usbPoll();
+            if (boot_phase_running(BOOT_USB) && usbConfiguration) {
+                boot_phase_end(BOOT_USB);
+            }
 
             // TODO: configuration process is incosistent. it sometime fails.
             // To prevent failing to configure NOT scan keyboard during configuration
@@ -95,6 +95,12 @@ int main(void)
                 keyboard_task();
             }
             vusb_transfer_keyboard();
+#ifdef SLEEP_ENABLE
+            // wake up on next timer tick or USB packet unless work is due now
+            if (keyboard_deadline()) {
+                sleep_idle();
+            }
+#endif
         }
     }
 }
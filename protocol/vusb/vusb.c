@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "report.h"
 #include "print.h"
 #include "debug.h"
+#include "perf.h"
 #include "host_driver.h"
 #include "vusb.h"
 
@@ -86,6 +87,7 @@ static void send_keyboard(report_keyboard_t *report)
         kbuf[kbuf_head] = *report;
         kbuf_head = next;
     } else {
+        PERF_COUNT(PERF_REPORT_DROPPED);
         debug("kbuf: full\n");
     }
 }
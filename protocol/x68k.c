@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "x68k.h"
+#include "perf.h"
 
 
 void x68k_init(void)
@@ -71,5 +72,9 @@ ISR(KBD_RX_VECT)
     if (next != rbuf_tail) {
         rbuf[rbuf_head] = KBD_RX_DATA;
         rbuf_head = next;
+        PERF_COUNT(PERF_RECV);
+        PERF_MAX(PERF_MAX_RECV, (rbuf_head - rbuf_tail + RBUF_SIZE) % RBUF_SIZE);
+    } else {
+        PERF_COUNT(PERF_RECV_DROPPED);
     }
 }